@@ -0,0 +1,26 @@
+/**
+ * Runs the native and the JS benchmarks
+ *
+ * npm run bench [-- iterations of the JS benchmarks]
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+var path = require('path');
+var spawn = require('child_process').spawn;
+
+var release = path.join(__dirname, '..', 'build', 'Release');
+var args = process.argv.slice(2);
+
+function exec(command, argv, done) {
+	spawn(command, argv, { stdio: 'inherit' }).on('exit', function(code) {
+		if (code)
+			process.exit(code);
+		done();
+	});
+}
+
+exec(path.join(release, 'bench'), [], function() {
+	exec(process.execPath, ['--expose-gc', path.join(__dirname, 'report.js')].concat(args), function() {});
+});
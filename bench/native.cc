@@ -0,0 +1,460 @@
+/**
+ * Native hot paths without V8: Convert::*, report decoding through the
+ * schema tables against the hand-written conversions they replaced and
+ * reading feature reports through a Backend. Checks the batch conversion
+ * kernels against the scalar functions and the schema against the
+ * hand-written decoding first.
+ *
+ * build/Release/bench [iterations]
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+
+#include "../src/io.h"
+#include "../src/convert.h"
+#include "../src/replay.h"
+#include "../src/schema.h"
+
+// counts operator new calls to report allocations per op
+static unsigned long allocations = 0;
+
+void *operator new(size_t size) throw(std::bad_alloc) {
+
+	allocations++;
+
+	void *ptr = malloc(size ? size : 1);
+
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete(void *ptr) throw() {
+	free(ptr);
+}
+
+// keeps results alive so the compiler can't drop the measured work
+static volatile double sink;
+
+static uint64_t now() {
+
+	struct timespec clock;
+	clock_gettime(CLOCK_MONOTONIC, &clock);
+
+	return (uint64_t) clock.tv_sec * 1000000000 + clock.tv_nsec;
+}
+
+/**
+ * The conversions of IO::getData as they were written out by hand before
+ * the schema tables (3e2373f), the baseline for Schema::numbers(). Values
+ * are in the order of the data table, hex bytes are the raw byte.
+ * @param const unsigned char *raw
+ * @param const IO::pumpSettingsReport *settings
+ * @param double *values
+ * @return size_t Number of values
+ */
+static size_t handWritten(const unsigned char *raw, const IO::pumpSettingsReport *settings, double *values) {
+
+	const IO::pumpDataReport *report = (const IO::pumpDataReport*) raw;
+	size_t count = 0;
+
+	values[count++] = Convert::controllerOutScale(report->controllerI);
+	values[count++] = Convert::controllerOutScale(report->controllerP);
+	values[count++] = Convert::controllerOutScale(report->controllerD);
+	values[count++] = Convert::controllerOutScale(report->controllerOut);
+	values[count++] = report->flow;
+	values[count++] = (int) Convert::frequency(report->frequency);
+	values[count++] = Convert::fanRpm(report->frequencyMax, settings->measureFanEdges);
+	values[count++] = Convert::fanVoltage(report->rawSensorData[3]);
+	values[count++] = Convert::voltage(report->rawSensorData[4]) * (Convert::scalePercent(report->fanPower) / 100);
+	values[count++] = Convert::voltage(report->rawSensorData[4]);
+	values[count++] = Convert::current(report->rawSensorData[5]);
+	values[count++] = (Convert::current(report->rawSensorData[5]) * Convert::voltage(report->rawSensorData[4])) / 1000;
+	values[count++] = Convert::fanRpm(report->fanRpm, settings->measureFanEdges);
+	values[count++] = Convert::scalePercent(report->fanPower);
+	values[count++] = Convert::temperature(report->temperatureRaw[0]);
+	values[count++] = Convert::temperature(report->temperatureRaw[1]);
+	values[count++] = Convert::temperature(report->temperatureRaw[2]);
+	values[count++] = report->alarmSensor0;
+	values[count++] = report->alarmSensor1;
+	values[count++] = report->alarmFan;
+	values[count++] = report->alarmFlow;
+	values[count++] = report->modeAdvancedPumpSettings;
+	values[count++] = report->modeAquastreamModeAdvanced;
+	values[count++] = report->modeAquastreamModeUltra;
+	values[count++] = report->firmware;
+	values[count++] = report->bootloader;
+	values[count++] = report->hardware;
+	values[count++] = report->serial;
+
+	for (int i = 0; i < 6; i++)
+		values[count++] = report->publicKey[i];
+
+	return count;
+}
+
+static double sum(const double *values, size_t count) {
+
+	double sum = 0;
+
+	for (size_t i = 0; i < count; i++)
+		sum += values[i];
+
+	return sum;
+}
+
+/**
+ * Fills a data and a settings report with plausible values
+ * @param IO::pumpDataReport *data
+ * @param IO::pumpSettingsReport *settings
+ */
+static void fixture(IO::pumpDataReport *data, IO::pumpSettingsReport *settings) {
+
+	memset(data, 0, sizeof(*data));
+	memset(settings, 0, sizeof(*settings));
+
+	data->rawSensorData[3] = 700;
+	data->rawSensorData[4] = 740;
+	data->rawSensorData[5] = 400;
+	data->temperatureRaw[0] = 3512;
+	data->temperatureRaw[1] = 2890;
+	data->temperatureRaw[2] = 3105;
+	data->frequency = 10000;
+	data->frequencyMax = 9000;
+	data->flow = 12000;
+	data->fanRpm = 2000;
+	data->fanPower = 128;
+	data->controllerOut = 0x400000;
+	data->serial = 4711;
+
+	settings->measureFanEdges = 2;
+	settings->measureFlowEdges = 2;
+	settings->pumpFrequency = 10000;
+}
+
+/**
+ * Writes data and settings report as a replay recording
+ * @param char *path mkstemp template, replaced with the file name
+ * @return bool
+ */
+static bool record(char *path, const IO::pumpDataReport *data, const IO::pumpSettingsReport *settings) {
+
+	int fd = mkstemp(path);
+
+	if (fd < 0)
+		return false;
+
+	FILE *file = fdopen(fd, "wb");
+	unsigned char header[3];
+
+	header[0] = IO::DATA_REPORT;
+	header[1] = sizeof(*data) & 0xff;
+	header[2] = sizeof(*data) >> 8;
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(data, 1, sizeof(*data), file);
+
+	header[0] = IO::SETTINGS_REPORT;
+	header[1] = sizeof(*settings) & 0xff;
+	header[2] = sizeof(*settings) >> 8;
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(settings, 1, sizeof(*settings), file);
+
+	return fclose(file) == 0;
+}
+
+/**
+ * Prints ns/op and allocations/op of a benchmark
+ * @param const char *name
+ * @param uint64_t start
+ * @param unsigned long allocated operator new calls before the run
+ * @param long iterations
+ */
+static void report(const char *name, uint64_t start, unsigned long allocated, long iterations) {
+
+	double ns = (double)(now() - start) / iterations;
+	double allocs = (double)(allocations - allocated) / iterations;
+
+	printf("native %-32s %10.1f ns/op %8.2f allocs/op\n", name, ns, allocs);
+}
+
+#define BENCH(name, body) \
+	do { \
+		unsigned long allocated = allocations; \
+		uint64_t start = now(); \
+		for (long i = 0; i < iterations; i++) { body; } \
+		report(name, start, allocated, iterations); \
+	} while (0)
+
+// a month of samples at 1 Hz, ns/op is per value
+static const long MONTH = 30L * 24 * 3600;
+
+#define BATCH(name, body) \
+	do { \
+		unsigned long allocated = allocations; \
+		uint64_t start = now(); \
+		body; \
+		sink = out[MONTH - 1]; \
+		report(name, start, allocated, MONTH); \
+	} while (0)
+
+/**
+ * Compares batch results with the scalar ones bit for bit
+ * @return bool false after printing the first mismatch
+ */
+template <typename Raw, typename Out>
+static bool matches(const char *kernel, const char *column, const Raw *raw, const Out *out, const Out *expected, size_t count) {
+
+	for (size_t i = 0; i < count; i++) {
+
+		if (memcmp(&out[i], &expected[i], sizeof(Out))) {
+			fprintf(stderr, "native verify %s %s: raw %u gives %.17g, scalar %.17g\n",
+				kernel, column, (unsigned int) raw[i], (double) out[i], (double) expected[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#define VERIFY(column, raw, out, expected, batch, scalar) \
+	do { \
+		batch; \
+		for (size_t i = 0; i < count; i++) expected[i] = scalar; \
+		if (!matches(kernel, column, raw, out, expected, count)) goto done; \
+	} while (0)
+
+/**
+ * Checks every batch conversion against its scalar function with the
+ * kernel selected by Convert::useKernel()
+ * @return bool
+ */
+static bool verifyKernel(const char *kernel, const u_int16_t *raw16, const u_int32_t *raw32, size_t count) {
+
+	double *out = (double*) malloc(count * sizeof(double));
+	double *expected = (double*) malloc(count * sizeof(double));
+	float *outf = (float*) malloc(count * sizeof(float));
+	float *expectedf = (float*) malloc(count * sizeof(float));
+	bool ok = false;
+
+	VERIFY("temperature", raw16, out, expected,
+		Convert::temperature(raw16, out, count),
+		Convert::temperature(raw16[i]));
+	VERIFY("temperature float", raw16, outf, expectedf,
+		Convert::temperature(raw16, outf, count),
+		(float) Convert::temperature(raw16[i]));
+	VERIFY("flow", raw32, out, expected,
+		Convert::flow(raw32, 2, 169, out, count),
+		Convert::flow(raw32[i], 2, 169));
+	VERIFY("flow float", raw32, outf, expectedf,
+		Convert::flow(raw32, 2, 169, outf, count),
+		(float) Convert::flow(raw32[i], 2, 169));
+	VERIFY("fanRpm u16", raw16, out, expected,
+		Convert::fanRpm(raw16, 2, out, count),
+		Convert::fanRpm(raw16[i], 2));
+	VERIFY("fanRpm", raw32, out, expected,
+		Convert::fanRpm(raw32, 2, out, count),
+		Convert::fanRpm(raw32[i], 2));
+	VERIFY("fanRpm float", raw32, outf, expectedf,
+		Convert::fanRpm(raw32, 2, outf, count),
+		(float) Convert::fanRpm(raw32[i], 2));
+	VERIFY("voltage", raw16, out, expected,
+		Convert::voltage(raw16, out, count),
+		Convert::voltage(raw16[i]));
+	VERIFY("fanVoltage", raw16, out, expected,
+		Convert::fanVoltage(raw16, out, count),
+		Convert::fanVoltage(raw16[i]));
+	ok = true;
+
+done:
+
+	free(out);
+	free(expected);
+	free(outf);
+	free(expectedf);
+
+	return ok;
+}
+
+/**
+ * Runs verifyKernel() over the full u16 input range with every kernel
+ * the CPU has. u32 columns also get the cutoffs and values with the top
+ * bit set, which the vector loads have to convert as unsigned.
+ * @return bool
+ */
+static bool verify() {
+
+	static const char *kernels[] = { "scalar", "sse2", "avx2" };
+	static const u_int32_t edges[] = { 299999, 300000, 599999, 600000, 0x7fffffff, 0x80000000, 0xffffffff };
+
+	// not a multiple of 4, so the scalar tail after the vector loops runs too
+	const size_t count = 65536 + sizeof(edges) / sizeof(edges[0]);
+
+	u_int16_t *raw16 = (u_int16_t*) malloc(count * sizeof(u_int16_t));
+	u_int32_t *raw32 = (u_int32_t*) malloc(count * sizeof(u_int32_t));
+
+	for (size_t i = 0; i < count; i++) {
+		raw16[i] = i;
+		raw32[i] = i < 65536 ? i : edges[i - 65536];
+	}
+
+	int widest = Convert::useKernel(Convert::KERNEL_AVX2);
+	bool ok = true;
+
+	for (int k = Convert::KERNEL_SCALAR; k <= widest && ok; k++) {
+
+		Convert::useKernel(k);
+		ok = verifyKernel(kernels[k], raw16, raw32, count);
+
+		if (ok)
+			printf("native verify %-25s batch conversions match scalar\n", kernels[k]);
+	}
+
+	Convert::useKernel(widest);
+
+	free(raw16);
+	free(raw32);
+
+	return ok;
+}
+
+/**
+ * Checks Schema::numbers() against handWritten() on the fixture and on
+ * random data reports, bit for bit
+ * @return bool false after printing the first mismatch
+ */
+static bool verifyDecode(
+	const unsigned char *fixture,
+	const IO::pumpSettingsReport *settings,
+	double *values,
+	double *expected
+) {
+
+	unsigned char raw[sizeof(IO::pumpDataReport)];
+	memcpy(raw, fixture, sizeof(raw));
+
+	srand(4711);
+
+	for (int run = 0; run < 10000; run++) {
+
+		size_t count = Schema::numbers(IO::DATA_REPORT, raw, settings, values);
+		size_t written = handWritten(raw, settings, expected);
+
+		if (count != written) {
+			fprintf(stderr, "native verify decode: %u values, hand-written %u\n", (unsigned int) count, (unsigned int) written);
+			return false;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+
+			if (memcmp(&values[i], &expected[i], sizeof(double))) {
+				fprintf(stderr, "native verify decode: value %u is %.17g, hand-written %.17g\n",
+					(unsigned int) i, values[i], expected[i]);
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < sizeof(raw); i++)
+			raw[i] = rand();
+	}
+
+	printf("native verify %-25s schema matches hand-written\n", "decode(4)");
+
+	return true;
+}
+
+int main(int argc, char **argv) {
+
+	long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+
+	if (iterations <= 0)
+		iterations = 1000000;
+
+	if (!verify())
+		return 1;
+
+	IO::pumpDataReport data;
+	IO::pumpSettingsReport settings;
+	fixture(&data, &settings);
+
+	unsigned char raw[sizeof(data)];
+	memcpy(raw, &data, sizeof(data));
+
+	double values[Schema::MAX_ELEMENTS];
+	double expected[Schema::MAX_ELEMENTS];
+
+	if (!verifyDecode(raw, &settings, values, expected))
+		return 1;
+
+	// Convert
+	BENCH("Convert::temperature", sink = Convert::temperature(data.temperatureRaw[i % 3] + (i & 0xff)));
+	BENCH("Convert::toTemperature", sink = Convert::toTemperature(30.0 + (i & 0xff) / 100.0));
+	BENCH("Convert::frequency", sink = Convert::frequency(data.frequency + (i & 0xff)));
+	BENCH("Convert::fanRpm", sink = Convert::fanRpm(data.fanRpm + (i & 0xff), settings.measureFanEdges));
+	BENCH("Convert::flow", sink = Convert::flow(data.flow + (i & 0xff), settings.measureFlowEdges, 169));
+	BENCH("Convert::voltage", sink = Convert::voltage(data.rawSensorData[4] + (i & 0xff)));
+	BENCH("Convert::scalePercent", sink = Convert::scalePercent(i & 0xff));
+	BENCH("Convert::controllerOutScale", sink = Convert::controllerOutScale(data.controllerOut + (i & 0xff)));
+
+	// history columns, scalar against batch
+	u_int16_t *temperatures = (u_int16_t*) malloc(MONTH * sizeof(u_int16_t));
+	u_int32_t *rpms = (u_int32_t*) malloc(MONTH * sizeof(u_int32_t));
+	double *out = (double*) malloc(MONTH * sizeof(double));
+
+	for (long i = 0; i < MONTH; i++) {
+		temperatures[i] = data.temperatureRaw[i % 3] + (i & 0xff);
+		rpms[i] = data.fanRpm + (i & 0xff);
+	}
+
+	BATCH("month Convert::temperature", for (long i = 0; i < MONTH; i++) out[i] = Convert::temperature(temperatures[i]));
+	BATCH("month Convert::temperature batch", Convert::temperature(temperatures, out, MONTH));
+	BATCH("month Convert::fanRpm", for (long i = 0; i < MONTH; i++) out[i] = Convert::fanRpm(rpms[i], settings.measureFanEdges));
+	BATCH("month Convert::fanRpm batch", Convert::fanRpm(rpms, settings.measureFanEdges, out, MONTH));
+	BATCH("month Convert::flow", for (long i = 0; i < MONTH; i++) out[i] = Convert::flow(rpms[i], settings.measureFlowEdges, 169));
+	BATCH("month Convert::flow batch", Convert::flow(rpms, settings.measureFlowEdges, 169, out, MONTH));
+
+	free(temperatures);
+	free(rpms);
+	free(out);
+
+	// report decoding, the schema against the hand-written baseline
+	BENCH("decode(4) hand-written", sink = sum(values, handWritten(raw, &settings, values)));
+	BENCH("decode(4) Schema::numbers", sink = sum(values, Schema::numbers(IO::DATA_REPORT, raw, &settings, values)));
+	BENCH("decode(6) Schema::numbers", sink = sum(values,
+		Schema::numbers(IO::SETTINGS_REPORT, (const unsigned char*) &settings, &settings, values)));
+
+	// feature reports from a recording instead of a device
+	char path[] = "/tmp/aquastreamxt-bench-XXXXXX";
+
+	if (!record(path, &data, &settings)) {
+		perror("record");
+		return 1;
+	}
+
+	ReplayBackend *backend = ReplayBackend::open(path, 0);
+	unlink(path);
+
+	if (!backend) {
+		fprintf(stderr, "Couldn't read replay file\n");
+		return 1;
+	}
+
+	unsigned char buffer[IO::REPORT_LENGTH];
+
+	BENCH("Backend::getFeatureReport(4)", sink = backend->getFeatureReport(IO::DATA_REPORT, buffer, sizeof(data)));
+	BENCH("Backend::getFeatureReport(6)", sink = backend->getFeatureReport(IO::SETTINGS_REPORT, buffer, sizeof(settings)));
+	BENCH("getFeatureReport(4) + decode", backend->getFeatureReport(IO::DATA_REPORT, buffer, sizeof(data));
+		sink = sum(values, Schema::numbers(IO::DATA_REPORT, buffer, &settings, values)));
+
+	delete backend;
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * End to end cost of getReport / setReport
+ *
+ * Uses a replay recording unless --device is given, so no pump is needed.
+ *
+ * node --expose-gc bench/report.js [iterations] [--device]
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var Aquastream = require('../build/Release/aquastreamxt_api').Aquastream;
+
+var iterations = parseInt(process.argv[2], 10) || 10000;
+var device = process.argv.indexOf('--device') !== -1;
+
+/**
+ * Writes a recording with one data and one settings report,
+ * see doc/report-layout.md for the offsets
+ */
+function record(file) {
+
+	var data = new Buffer(65), settings = new Buffer(50);
+
+	data.fill(0);
+	data.writeUInt16LE(700, 6);
+	data.writeUInt16LE(740, 8);
+	data.writeUInt16LE(400, 10);
+	data.writeUInt16LE(3512, 12);
+	data.writeUInt16LE(2890, 14);
+	data.writeUInt16LE(3105, 16);
+	data.writeUInt16LE(10000, 18);
+	data.writeUInt16LE(9000, 20);
+	data.writeUInt32LE(12000, 22);
+	data.writeUInt32LE(2000, 26);
+	data.writeUInt8(128, 30);
+	data.writeUInt16LE(4711, 57);
+
+	settings.fill(0);
+	settings.writeUInt8(2, 5);
+	settings.writeUInt8(2, 6);
+	settings.writeUInt16LE(10000, 7);
+
+	function header(reportId, length) {
+		var buffer = new Buffer(3);
+		buffer.writeUInt8(reportId, 0);
+		buffer.writeUInt16LE(length, 1);
+		return buffer;
+	}
+
+	fs.writeFileSync(file, Buffer.concat([
+		header(4, data.length), data,
+		header(6, settings.length), settings
+	]));
+}
+
+/**
+ * Runs fn(callback) iterations times, then prints ns/op, heap bytes/op
+ * and the time a full GC needs to collect what the run left behind
+ */
+function run(name, fn, done) {
+
+	if (global.gc)
+		global.gc();
+
+	var heap = process.memoryUsage().heapUsed;
+	var start = process.hrtime();
+	var i = 0;
+
+	(function next() {
+
+		if (i++ === iterations) {
+			var time = process.hrtime(start);
+			var ns = (time[0] * 1e9 + time[1]) / iterations;
+			var bytes = (process.memoryUsage().heapUsed - heap) / iterations;
+			var gc = 'n/a (run with --expose-gc)';
+
+			if (global.gc) {
+				var gcStart = process.hrtime();
+				global.gc();
+				var gcTime = process.hrtime(gcStart);
+				gc = ((gcTime[0] * 1e3 + gcTime[1] / 1e6).toFixed(2)) + ' ms';
+			}
+
+			console.log('js     ' + name + new Array(Math.max(1, 33 - name.length)).join(' ') +
+				Math.round(ns) + ' ns/op, ' + Math.round(bytes) + ' heap bytes/op, gc ' + gc);
+			return done();
+		}
+
+		fn(function(err) {
+			if (err)
+				throw err;
+			next();
+		});
+	})();
+}
+
+var pump, file;
+
+if (device) {
+	pump = new Aquastream(0x0c70, 0xf0b6);
+} else {
+	file = path.join(os.tmpdir(), 'aquastreamxt-bench-' + process.pid + '.rec');
+	record(file);
+	pump = new Aquastream({ replay: file });
+}
+
+pump.getReport(6, function(err, settings) {
+
+	if (err)
+		throw err;
+
+	run('getReport(4)', function(cb) { pump.getReport(4, cb); }, function() {
+		run('getReport(6)', function(cb) { pump.getReport(6, cb); }, function() {
+			// alternate fanManualPower, unchanged settings would only time the skipped write
+			var power = settings.fanManualPower;
+			var other = power >= 50 ? power - 1 : power + 1;
+			var n = 0;
+
+			run('setReport(6)', function(cb) {
+				settings.fanManualPower = n++ % 2 ? power : other;
+				pump.setReport(6, settings, cb);
+			}, function() {
+				settings.fanManualPower = power;
+				pump.setReport(6, settings, function(err) {
+					if (err)
+						throw err;
+					if (file)
+						fs.unlinkSync(file);
+				});
+			});
+		});
+	});
+});
@@ -0,0 +1,70 @@
+/**
+ * hiddev against hidraw, needs a connected pump
+ *
+ * Reads the data report over each transport and prints the wall time and
+ * the CPU time (user + system, from /proc/self/stat) per read.
+ *
+ * node bench/transport.js [iterations]
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+var fs = require('fs');
+var Aquastream = require('../build/Release/aquastreamxt_api').Aquastream;
+
+var iterations = parseInt(process.argv[2], 10) || 1000;
+
+// clock ticks per second, USER_HZ is 100 on all common architectures
+var TICK_NS = 1e9 / 100;
+
+/**
+ * utime + stime of this process in ns
+ */
+function cpu() {
+	var stat = fs.readFileSync('/proc/self/stat', 'utf8');
+	var fields = stat.slice(stat.lastIndexOf(')') + 2).split(' ');
+	return (parseInt(fields[11], 10) + parseInt(fields[12], 10)) * TICK_NS;
+}
+
+function run(transport, done) {
+
+	var pump;
+
+	try {
+		pump = new Aquastream(0x0c70, 0xf0b6, { transport: transport });
+	} catch (e) {
+		console.log(transport + '  ' + e.message);
+		return done();
+	}
+
+	Aquastream.resetStats();
+	var cpuStart = cpu();
+	var start = process.hrtime();
+	var i = 0;
+
+	(function next() {
+
+		if (i++ === iterations) {
+			var time = process.hrtime(start);
+			var ns = (time[0] * 1e9 + time[1]) / iterations;
+			var cpuNs = (cpu() - cpuStart) / iterations;
+			var ioctls = Aquastream.getStats();
+			var get = ioctls[transport === 'hidraw' ? 'HIDIOCGFEATURE' : 'HIDIOCGREPORT'];
+
+			console.log(transport + '  ' + Math.round(ns) + ' ns/read, ' + Math.round(cpuNs) +
+				' cpu ns/read, ioctl p50 ' + get.p50 + ' ns, p99 ' + get.p99 + ' ns');
+			return done();
+		}
+
+		pump.getRawReport(4, function(err) {
+			if (err)
+				throw err;
+			next();
+		});
+	})();
+}
+
+run('hiddev', function() {
+	run('hidraw', function() {});
+});
@@ -2,7 +2,47 @@
   "targets": [
     {
       "target_name": "aquastreamxt_api",
-      "sources": [ "src/aquastreamxt.cc", "src/io.cc", "src/convert.cc" ]
+      "sources": [
+        "src/aquastreamxt.cc",
+        "src/group.cc",
+        "src/device.cc",
+        "src/backend.cc",
+        "src/replay.cc",
+        "src/recording.cc",
+        "src/hidraw.cc",
+        "src/sampler.cc",
+        "src/history.cc",
+        "src/projection.cc",
+        "src/deadband.cc",
+        "src/adaptive.cc",
+        "src/alarms.cc",
+        "src/schema.cc",
+        "src/stats.cc",
+        "src/metrics.cc",
+        "src/shared.cc",
+        "src/reader.cc",
+        "src/broker.cc",
+        "src/client.cc",
+        "src/async.cc",
+        "src/typedarray.cc",
+        "src/io.cc",
+        "src/convert.cc",
+        "src/fields.cc"
+      ],
+      "libraries": [
+        "-lrt"
+      ]
+    },
+    {
+      "target_name": "bench",
+      "type": "executable",
+      "sources": [
+        "bench/native.cc",
+        "src/replay.cc",
+        "src/recording.cc",
+        "src/convert.cc",
+        "src/fields.cc"
+      ]
     }
   ]
-}
\ No newline at end of file
+}
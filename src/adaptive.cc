@@ -0,0 +1,96 @@
+/**
+ * Adaptive sampling interval
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <math.h>
+
+#include "adaptive.h"
+#include "convert.h"
+
+const AdaptiveInterval::Thresholds AdaptiveInterval::DEFAULT_THRESHOLDS = { 0.05, 2, 2 };
+
+// weight of the newest rate, the rest is the previous average
+static const double SMOOTHING = 0.5;
+
+AdaptiveInterval::AdaptiveInterval(uint64_t min, uint64_t max, const Thresholds &thresholds) {
+
+	this->min = min;
+	this->max = max > min ? max : min;
+	this->current = min;
+	this->last = 0;
+
+	this->thresholds[0] = thresholds.temperature;
+	this->thresholds[1] = thresholds.flow;
+	this->thresholds[2] = thresholds.pumpCurrent;
+
+	for (int i = 0; i < SIGNALS; i++) {
+		values[i] = 0;
+		rates[i] = 0;
+	}
+};
+
+/**
+ * Feeds a sample, returns the interval until the next one
+ * @param uint64_t timestamp CLOCK_MONOTONIC in ns
+ * @param const IO::pumpDataReport *data
+ * @return uint64_t ns
+ */
+uint64_t AdaptiveInterval::update(uint64_t timestamp, const IO::pumpDataReport *data) {
+
+	double sample[SIGNALS] = {
+		Convert::temperature(data->temperatureRaw[2]),
+		(double) data->flow,
+		(double) Convert::current(data->rawSensorData[5])
+	};
+
+	bool alarm = data->alarmSensor0 || data->alarmSensor1 || data->alarmFan || data->alarmFlow;
+	double activity = 0;
+
+	if (last && timestamp > last) {
+
+		double seconds = (timestamp - last) / 1e9;
+
+		for (int i = 0; i < SIGNALS; i++) {
+
+			double change = fabs(sample[i] - values[i]) / seconds;
+
+			// flow and current relative to their value, starting from 0 is fast
+			if (i > 0 && values[i] != 0)
+				change = change * 100 / fabs(values[i]);
+			else if (i > 0 && change != 0)
+				change = 2 * thresholds[i];
+
+			rates[i] += SMOOTHING * (change - rates[i]);
+
+			if (thresholds[i] > 0 && rates[i] / thresholds[i] > activity)
+				activity = rates[i] / thresholds[i];
+		}
+	}
+
+	for (int i = 0; i < SIGNALS; i++)
+		values[i] = sample[i];
+
+	last = timestamp;
+
+	uint64_t interval = current;
+
+	if (alarm || activity >= 1)
+		interval = min;
+	else if (activity < 0.5)
+		interval = interval + interval / 2 < max ? interval + interval / 2 : max;
+
+	__atomic_store_n(&current, interval, __ATOMIC_RELAXED);
+
+	return interval;
+};
+
+/**
+ * Interval in ns the sampler currently waits between two reads
+ * @return uint64_t
+ */
+uint64_t AdaptiveInterval::interval() const {
+	return __atomic_load_n(&current, __ATOMIC_RELAXED);
+};
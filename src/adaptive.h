@@ -0,0 +1,61 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdint.h>
+
+#include "io.h"
+
+/**
+ * Picks the sampling interval from how fast the readings move
+ *
+ * Water temperature, flow and pump current are tracked as smoothed rates
+ * of change. Once one of them reaches its threshold or an alarm bit is
+ * set, the interval drops to the minimum. While all of them stay below
+ * half their threshold, it grows by half per sample up to the maximum.
+ * update() runs on the sampling thread, interval() may be read anywhere.
+ */
+class AdaptiveInterval {
+
+	public:
+
+		/**
+		 * Rates of change that count as fast, temperature in °C/s, flow
+		 * and pump current in % of their value per second
+		 */
+		struct Thresholds {
+			double temperature;
+			double flow;
+			double pumpCurrent;
+		};
+
+		static const Thresholds DEFAULT_THRESHOLDS;
+
+		AdaptiveInterval(uint64_t min, uint64_t max, const Thresholds &thresholds);
+
+		uint64_t update(uint64_t timestamp, const IO::pumpDataReport *data);
+		uint64_t interval() const;
+
+	private:
+
+		static const int SIGNALS = 3;
+
+		uint64_t min;
+		uint64_t max;
+		double thresholds[SIGNALS];
+
+		// current interval in ns
+		uint64_t current;
+
+		// previous sample, last = 0 before the first one
+		uint64_t last;
+		double values[SIGNALS];
+		double rates[SIGNALS];
+
+};
+
+#endif
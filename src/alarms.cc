@@ -0,0 +1,264 @@
+/**
+ * Event driven alarm notifications
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <v8.h>
+#include <linux/hiddev.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alarms.h"
+#include "aquastreamxt.h"
+#include "async.h"
+#include "deadband.h"
+#include "sampler.h"
+
+using namespace v8;
+
+Alarms::Alarms(Aquastream *aquastream, int handle) {
+
+	this->aquastream = aquastream;
+	this->handle = handle;
+	this->reading = false;
+	this->pending = false;
+	this->closing = false;
+	this->polling = true;
+	this->changed = 0;
+	this->error = 0;
+
+	std::string error;
+
+	// no deadbands, only the alarm bits are watched
+	HandleScope scope;
+	deadband = Deadband::compile(Object::New(), &error);
+
+	request.data = this;
+
+	uv_poll_init(uv_default_loop(), &poll, handle);
+	poll.data = this;
+	uv_poll_start(&poll, UV_READABLE, readable);
+};
+
+Alarms::~Alarms() {
+
+	for (size_t i = 0; i < listeners.size(); i++)
+		listeners[i].Dispose();
+
+	delete deadband;
+
+	close(handle);
+};
+
+/**
+ * Opens a second handle of the device and starts watching it, hiddev is
+ * switched to usage events, hidraw delivers input reports as they are
+ *
+ * @param Aquastream *aquastream
+ * @return Alarms* NULL if the device has no node to watch
+ */
+Alarms *Alarms::open(Aquastream *aquastream) {
+
+	char devicePath[PATH_MAX];
+
+	if (aquastream->device->getHandle() < 0 || aquastream->device->getDevicePath(devicePath, sizeof(devicePath)) < 0)
+		return NULL;
+
+	int handle = ::open(devicePath, O_RDONLY | O_NONBLOCK);
+
+	if (handle < 0)
+		return NULL;
+
+	if (strstr(devicePath, "hiddev")) {
+
+		int flags = HIDDEV_FLAG_UREF | HIDDEV_FLAG_REPORT;
+
+		if (ioctl(handle, HIDIOCSFLAG, &flags) < 0) {
+			close(handle);
+			return NULL;
+		}
+	}
+
+	Alarms *alarms = new Alarms(aquastream, handle);
+
+	aquastream->Ref();
+
+	// the current state is the first event
+	alarms->read();
+
+	return alarms;
+};
+
+void Alarms::addListener(Handle<Function> listener) {
+	listeners.push_back(Persistent<Function>::New(listener));
+};
+
+/**
+ * Removes a listener, all of them if it isn't a function
+ * @return bool true if there are no listeners left
+ */
+bool Alarms::removeListener(Handle<Value> listener) {
+
+	for (size_t i = listeners.size(); i-- > 0;) {
+		if (!listener->IsFunction() || listeners[i]->StrictEquals(listener)) {
+			listeners[i].Dispose();
+			listeners.erase(listeners.begin() + i);
+		}
+	}
+
+	return listeners.empty();
+};
+
+/**
+ * Stops watching, frees the instance once the handle is closed and no
+ * read is in flight
+ */
+void Alarms::stop() {
+
+	if (closing)
+		return;
+
+	closing = true;
+
+	uv_poll_stop(&poll);
+	uv_close((uv_handle_t*) &poll, closed);
+};
+
+void Alarms::closed(uv_handle_t *handle) {
+
+	Alarms *alarms = static_cast<Alarms*>(handle->data);
+
+	alarms->polling = false;
+	alarms->release();
+};
+
+void Alarms::release() {
+
+	if (polling || reading)
+		return;
+
+	aquastream->Unref();
+	delete this;
+};
+
+/**
+ * Drains the queued events, their content doesn't matter as the alarm
+ * bits are read from the data report. Errors and EOF, which is what an
+ * unplugged device reads, stop the poll, so listeners get them once.
+ */
+void Alarms::readable(uv_poll_t *poll, int status, int events) {
+
+	Alarms *alarms = static_cast<Alarms*>(poll->data);
+
+	if (status < 0) {
+		HandleScope scope;
+		uv_poll_stop(poll);
+		alarms->dispatch(Async::error("Couldn't watch the device"), Undefined());
+		return;
+	}
+
+	struct hiddev_usage_ref buffer[64];
+	ssize_t ret;
+
+	while ((ret = ::read(alarms->handle, buffer, sizeof(buffer))) > 0);
+
+	if (ret == 0) {
+		HandleScope scope;
+		uv_poll_stop(poll);
+		alarms->dispatch(Async::error("Device was disconnected"), Undefined());
+		return;
+	}
+
+	if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+		HandleScope scope;
+		uv_poll_stop(poll);
+		alarms->dispatch(Async::error("Couldn't read device events"), Undefined());
+		return;
+	}
+
+	alarms->read();
+};
+
+/**
+ * Reads the data report unless a read is in flight, events arriving
+ * meanwhile are coalesced into one more read
+ */
+void Alarms::read() {
+
+	if (reading) {
+		pending = true;
+		return;
+	}
+
+	reading = true;
+	pending = false;
+
+	uv_queue_work(uv_default_loop(), &request, ReadWork, ReadAfter);
+};
+
+void Alarms::ReadWork(uv_work_t *request) {
+
+	Alarms *alarms = static_cast<Alarms*>(request->data);
+
+	alarms->error = alarms->aquastream->device->readData(&alarms->data, &alarms->settings);
+	alarms->changed = alarms->error < 0 ? 0 : alarms->deadband->compare(&alarms->data, &alarms->settings);
+};
+
+/**
+ * Dispatches { timestamp, changes: { 'alarm.flow': 1, ... } } if an alarm
+ * bit flipped
+ */
+void Alarms::ReadAfter(uv_work_t *request, int status) {
+
+	HandleScope scope;
+
+	Alarms *alarms = static_cast<Alarms*>(request->data);
+
+	alarms->reading = false;
+
+	if (alarms->closing) {
+		alarms->release();
+		return;
+	}
+
+	if (alarms->error >= 0)
+		alarms->aquastream->sampled(Sampler::now(), &alarms->data);
+
+	if (alarms->error < 0) {
+		alarms->dispatch(Async::error(IO::errorString(alarms->error)), Undefined());
+	} else if (alarms->changed) {
+
+		Local<Object> event = Object::New();
+
+		event->Set(String::NewSymbol("timestamp"), Number::New(Sampler::now() / 1e6));
+		event->Set(String::NewSymbol("changes"), alarms->deadband->changes(alarms->changed, &alarms->data, &alarms->settings));
+
+		alarms->dispatch(Null(), event);
+	}
+
+	if (alarms->pending && !alarms->closing)
+		alarms->read();
+};
+
+/**
+ * Calls every listener, a listener may remove listeners or stop watching
+ */
+void Alarms::dispatch(Handle<Value> error, Handle<Value> event) {
+
+	HandleScope scope;
+
+	std::vector<Local<Function> > current;
+
+	for (size_t i = 0; i < listeners.size(); i++)
+		current.push_back(Local<Function>::New(listeners[i]));
+
+	for (size_t i = 0; i < current.size(); i++)
+		Async::complete(current[i], error, event);
+};
@@ -0,0 +1,75 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef ALARMS_H
+#define ALARMS_H
+
+#include <node.h>
+#include <uv.h>
+#include <vector>
+
+#include "io.h"
+
+class Aquastream;
+class Deadband;
+
+/**
+ * Alarm notifications driven by the events of the device node
+ *
+ * A second handle of the device is watched with uv_poll_t, so nothing runs
+ * while the pump is quiet. When it signals, the pending events are drained,
+ * the data report is read on the threadpool and the listeners get the alarm
+ * bits that flipped.
+ */
+class Alarms {
+
+	public:
+
+		static Alarms *open(Aquastream *aquastream);
+
+		void addListener(v8::Handle<v8::Function> listener);
+		bool removeListener(v8::Handle<v8::Value> listener);
+
+		void stop();
+
+	private:
+
+		Alarms(Aquastream *aquastream, int handle);
+		~Alarms();
+
+		static void readable(uv_poll_t *poll, int status, int events);
+		static void closed(uv_handle_t *handle);
+		static void ReadWork(uv_work_t *request);
+		static void ReadAfter(uv_work_t *request, int status);
+
+		void read();
+		void dispatch(v8::Handle<v8::Value> error, v8::Handle<v8::Value> event);
+		void release();
+
+		Aquastream *aquastream;
+		std::vector<v8::Persistent<v8::Function> > listeners;
+
+		// our own handle of the device node, its event queue isn't shared
+		int handle;
+		uv_poll_t poll;
+
+		uv_work_t request;
+
+		// a read is in flight, pending = signaled again meanwhile
+		bool reading;
+		bool pending;
+		bool closing;
+		bool polling;
+
+		// alarm bits last dispatched, only touched by one read at a time
+		Deadband *deadband;
+		IO::pumpDataReport data;
+		IO::pumpSettingsReport settings;
+		uint64_t changed;
+		int error;
+
+};
+
+#endif
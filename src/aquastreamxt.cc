@@ -6,18 +6,105 @@
  */
 
 #include <node.h>
+#include <node_buffer.h>
 #include <v8.h>
 #include <sys/stat.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
 #include "aquastreamxt.h"
+#include "async.h"
 #include "io.h"
+#include "sampler.h"
+#include "history.h"
+#include "group.h"
+#include "stats.h"
+#include "projection.h"
+#include "schema.h"
+#include "deadband.h"
+#include "adaptive.h"
+#include "alarms.h"
+#include "recording.h"
+#include "typedarray.h"
+#include "metrics.h"
+#include "shared.h"
+#include "reader.h"
+#include "broker.h"
+#include "client.h"
 
 using namespace v8;
 
-Aquastream::Aquastream() {};
-Aquastream::~Aquastream() {};
+/**
+ * State of a getReport / setReport call while it's on the threadpool
+ */
+struct ReportBaton {
+	uv_work_t request;
+	Aquastream *aquastream;
+	Persistent<Function> callback;
+	int reportId;
+	int error;
+	uint64_t timestamp;
+	Projection *projection;
+	IO::pumpDataReport data;
+	IO::pumpSettingsReport settings;
+
+	// setReport: bits of settings to apply, settings before and after the write
+	IO::pumpSettingsReport mask;
+	IO::pumpSettingsReport before;
+};
+
+/**
+ * State of a getDeviceInfo call while it's on the threadpool
+ */
+struct DeviceInfoBaton {
+	uv_work_t request;
+	Aquastream *aquastream;
+	Persistent<Function> callback;
+	char devicePath[PATH_MAX];
+};
+
+/**
+ * State of a getRawReport call, the report is read straight into the Buffer
+ */
+struct RawReportBaton {
+	uv_work_t request;
+	Aquastream *aquastream;
+	Persistent<Function> callback;
+	Persistent<Object> buffer;
+	unsigned char *data;
+	size_t length;
+	int reportId;
+	int error;
+};
+
+Aquastream::Aquastream() {
+	vendorId = 0;
+	productId = 0;
+	device = NULL;
+	sampler = NULL;
+	alarms = NULL;
+	broker = NULL;
+	history = NULL;
+	recorder = NULL;
+	publisher = NULL;
+	metrics = NULL;
+	latestTime = 0;
+};
+
+Aquastream::~Aquastream() {
+
+	delete history;
+	delete recorder;
+	delete publisher;
+	delete metrics;
+	delete device;
+};
 
 void Aquastream::Init(Handle<Object> target) {
 
+	// Property keys and result object templates
+	IO::Init();
+
 	// Prepare constructor template
 	Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
 	tpl->SetClassName(String::NewSymbol("Aquastream"));
@@ -39,6 +126,112 @@ void Aquastream::Init(Handle<Object> target) {
         FunctionTemplate::New(GetDeviceInfo)->GetFunction()
     );
 
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("getRawReport"),
+		FunctionTemplate::New(GetRawReport)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("startSampling"),
+		FunctionTemplate::New(StartSampling)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("stopSampling"),
+		FunctionTemplate::New(StopSampling)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("getSamplingStatus"),
+		FunctionTemplate::New(GetSamplingStatus)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("getMetricsText"),
+		FunctionTemplate::New(GetMetricsText)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("startPublishing"),
+		FunctionTemplate::New(StartPublishing)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("stopPublishing"),
+		FunctionTemplate::New(StopPublishing)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("startBroker"),
+		FunctionTemplate::New(StartBroker)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("stopBroker"),
+		FunctionTemplate::New(StopBroker)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("startRecording"),
+		FunctionTemplate::New(StartRecording)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("stopRecording"),
+		FunctionTemplate::New(StopRecording)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("watchAlarms"),
+		FunctionTemplate::New(WatchAlarms)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("unwatchAlarms"),
+		FunctionTemplate::New(UnwatchAlarms)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("enableHistory"),
+		FunctionTemplate::New(EnableHistory)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("disableHistory"),
+		FunctionTemplate::New(DisableHistory)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("queryHistory"),
+		FunctionTemplate::New(QueryHistory)->GetFunction()
+	);
+
+	// Static
+	tpl->Set(
+		String::NewSymbol("getReportLayout"),
+		FunctionTemplate::New(GetReportLayout)
+	);
+
+	tpl->Set(
+		String::NewSymbol("enumerate"),
+		FunctionTemplate::New(Enumerate)
+	);
+
+	tpl->Set(
+		String::NewSymbol("getStats"),
+		FunctionTemplate::New(GetStats)
+	);
+
+	tpl->Set(
+		String::NewSymbol("resetStats"),
+		FunctionTemplate::New(ResetStats)
+	);
+
+	tpl->Set(
+		String::NewSymbol("readRecording"),
+		FunctionTemplate::New(ReadRecording)
+	);
+
 	Persistent<Function> constructor = Persistent<Function>::New(tpl->GetFunction());
 	target->Set(String::NewSymbol("Aquastream"), constructor);
 };
@@ -48,10 +241,75 @@ Handle<Value> Aquastream::New(const Arguments& args) {
 	HandleScope scope;
 
 	Aquastream* aquastream = new Aquastream();
-	aquastream->vendorId = args[0]->NumberValue();
-	aquastream->productId = args[1]->NumberValue();
+	Local<Value> options = args[2];
+
+	if (args[0]->IsObject()) {
+
+		// new Aquastream({ replay: path, rate: reads per second, ... })
+		options = args[0];
+		Local<Object> replay = options->ToObject();
+
+		if (!replay->Get(String::NewSymbol("replay"))->IsString()) {
+			delete aquastream;
+			ThrowException(Exception::TypeError(String::New("Invalid replay file")));
+			return scope.Close(Undefined());
+		}
+
+		aquastream->device = Device::openReplay(
+			*String::Utf8Value(replay->Get(String::NewSymbol("replay"))),
+			replay->Get(String::NewSymbol("rate"))->NumberValue()
+		);
 
-	aquastream->handle = IO::openDevice(aquastream->vendorId, aquastream->productId);
+		if (!aquastream->device) {
+			delete aquastream;
+			ThrowException(Exception::Error(String::New("Couldn't read replay file")));
+			return scope.Close(Undefined());
+		}
+
+	} else {
+
+		aquastream->vendorId = args[0]->NumberValue();
+		aquastream->productId = args[1]->NumberValue();
+
+		// new Aquastream(vendorId, productId, { transport: 'hiddev' | 'hidraw', ... })
+		int transport = Device::TRANSPORT_AUTO;
+
+		if (options->IsObject()) {
+
+			Local<Value> name = options->ToObject()->Get(String::NewSymbol("transport"));
+
+			if (!name->IsUndefined()) {
+
+				String::Utf8Value value(name);
+
+				if (*value && !strcmp(*value, "hiddev")) {
+					transport = Device::TRANSPORT_HIDDEV;
+				} else if (*value && !strcmp(*value, "hidraw")) {
+					transport = Device::TRANSPORT_HIDRAW;
+				} else {
+					delete aquastream;
+					ThrowException(Exception::TypeError(String::New("Invalid transport")));
+					return scope.Close(Undefined());
+				}
+			}
+		}
+
+		aquastream->device = Device::open(aquastream->vendorId, aquastream->productId, transport);
+
+		if (!aquastream->device) {
+			delete aquastream;
+			ThrowException(Exception::Error(String::New("Couldn't find Aquastream XT!")));
+			return scope.Close(Undefined());
+		}
+	}
+
+	// options
+	if (options->IsObject()) {
+		Local<Value> settingsTtl = options->ToObject()->Get(String::NewSymbol("settingsTtl"));
+
+		if (settingsTtl->IsNumber())
+			aquastream->device->setSettingsTtl((uint64_t)(settingsTtl->NumberValue() * 1e6));
+	}
 
 	aquastream->Wrap(args.This());
 
@@ -59,11 +317,20 @@ Handle<Value> Aquastream::New(const Arguments& args) {
 
 };
 
+/**
+ * getReport(reportId, [options], [callback])
+ *
+ * Reads the feature report on the threadpool, callback gets (err, report).
+ * Returns a Promise if no callback is given.
+ *
+ * options.fields limits a data report to the given paths, e.g.
+ * ['current.temperature.water', 'current.flow']
+ */
 Handle<Value> Aquastream::GetReport(const Arguments& args) {
 
 	HandleScope scope;
 
-	if (args.Length() < 2) {
+	if (args.Length() < 1) {
 		ThrowException(Exception::TypeError(String::New("Wrong number of arguments")));
 		return scope.Close(Undefined());
 	}
@@ -73,30 +340,111 @@ Handle<Value> Aquastream::GetReport(const Arguments& args) {
 		return scope.Close(Undefined());
 	}
 
-	Aquastream* aquastream 	= ObjectWrap::Unwrap<Aquastream>(args.This());
 	int reportId = args[0]->NumberValue();
 
-	// get settings
-	Handle<Object> settings = IO::getSettings(Number::New(aquastream->handle), Number::New(reportId));
-	Handle<Object> returnValue;
+	if (reportId != IO::DATA_REPORT && reportId != IO::SETTINGS_REPORT) {
+		ThrowException(Exception::TypeError(String::New("Invalid Feature Report ID")));
+		return scope.Close(Undefined());
+	}
 
-	switch(reportId) {
-		case 4:
-			returnValue = IO::getData(Number::New(aquastream->handle), Number::New(reportId), settings);
-		break;
-		case 6:
-			returnValue = settings;
-        break;
+	Aquastream* aquastream 	= ObjectWrap::Unwrap<Aquastream>(args.This());
+	Projection *projection = NULL;
+	int callbackIndex = 1;
+
+	if (args[1]->IsObject() && !args[1]->IsFunction()) {
+
+		Local<Value> fields = args[1]->ToObject()->Get(String::NewSymbol("fields"));
+		callbackIndex = 2;
+
+		if (fields->IsArray()) {
+
+			if (reportId != IO::DATA_REPORT) {
+				ThrowException(Exception::TypeError(String::New("Fields can only be selected from the data report")));
+				return scope.Close(Undefined());
+			}
+
+			projection = Projection::get(Local<Array>::Cast(fields));
+
+			if (!projection)
+				return scope.Close(Undefined());
+
+		} else if (!fields->IsUndefined()) {
+			ThrowException(Exception::TypeError(String::New("Invalid fields")));
+			return scope.Close(Undefined());
+		}
 	}
 
-	Local<Function> cb = Local<Function>::Cast(args[1]);
-	const unsigned argc = 1;
-	Local<Value> argv[argc] = { Local<Object>::New(returnValue) };
-	cb->Call(Context::GetCurrent()->Global(), argc, argv);
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(args[callbackIndex], &returnValue);
 
-	return scope.Close(Undefined());
+	if (cb.IsEmpty()) {
+		if (projection)
+			projection->release();
+		return scope.Close(Undefined());
+	}
+
+	ReportBaton *baton = new ReportBaton();
+	baton->request.data = baton;
+	baton->aquastream = aquastream;
+	baton->callback = Persistent<Function>::New(cb);
+	baton->reportId = reportId;
+	baton->error = 0;
+	baton->projection = projection;
+
+	aquastream->Ref();
+	uv_queue_work(uv_default_loop(), &baton->request, GetReportWork, GetReportAfter);
+
+	return scope.Close(returnValue);
+};
+
+void Aquastream::GetReportWork(uv_work_t *request) {
+
+	ReportBaton *baton = static_cast<ReportBaton*>(request->data);
+	Device *device = baton->aquastream->device;
+
+	if (baton->reportId == IO::DATA_REPORT) {
+		baton->error = device->readData(&baton->data, &baton->settings);
+	} else {
+		baton->error = device->readSettings(&baton->settings, false);
+	}
+
+	baton->timestamp = Sampler::now();
+};
+
+void Aquastream::GetReportAfter(uv_work_t *request, int status) {
+
+	HandleScope scope;
+
+	ReportBaton *baton = static_cast<ReportBaton*>(request->data);
+
+	if (baton->error < 0) {
+		Async::complete(baton->callback, Async::error(IO::errorString(baton->error)), Undefined());
+	} else if (baton->reportId == IO::DATA_REPORT) {
+		baton->aquastream->sampled(baton->timestamp, &baton->data);
+
+		Async::complete(baton->callback, Null(), baton->projection
+			? baton->projection->project(&baton->data, &baton->settings)
+			: IO::getData(&baton->data, &baton->settings)
+		);
+	} else {
+		Async::complete(baton->callback, Null(), IO::getSettings(&baton->settings));
+	}
+
+	if (baton->projection)
+		baton->projection->release();
+
+	baton->aquastream->Unref();
+	baton->callback.Dispose();
+	delete baton;
 };
 
+/**
+ * setReport(reportId, settings, [callback])
+ *
+ * Merges the (possibly partial) settings over the current ones and writes
+ * them on the threadpool, unless nothing changed. Callback gets (err, paths
+ * of the changed fields). Returns a Promise if no callback is given.
+ */
 Handle<Value> Aquastream::SetReport(const Arguments& args) {
 
 	HandleScope scope;
@@ -111,45 +459,1076 @@ Handle<Value> Aquastream::SetReport(const Arguments& args) {
 		return scope.Close(Undefined());
 	}
 
-	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
 	int reportId = args[0]->NumberValue();
 
-	Handle<Value> returnValue;
-	Handle<Object> data = args[1]->ToObject();
+	if (reportId != IO::SETTINGS_REPORT) {
+		ThrowException(Exception::TypeError(String::New("Invalid Feature Report ID")));
+		return scope.Close(Undefined());
+	}
+
+	if (!args[1]->IsObject()) {
+		ThrowException(Exception::TypeError(String::New("Invalid settings")));
+		return scope.Close(Undefined());
+	}
+
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(args[2], &returnValue);
+
+	if (cb.IsEmpty())
+		return scope.Close(Undefined());
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	ReportBaton *baton = new ReportBaton();
+	baton->request.data = baton;
+	baton->aquastream = aquastream;
+	baton->reportId = reportId;
+	baton->error = 0;
+
+	// the settings object can only be read on this thread
+	TryCatch tryCatch;
+	IO::setSettings(args[1]->ToObject(), &baton->settings, &baton->mask);
+
+	if (tryCatch.HasCaught()) {
+		delete baton;
+		return scope.Close(tryCatch.ReThrow());
+	}
+
+	baton->callback = Persistent<Function>::New(cb);
+
+	aquastream->Ref();
+	uv_queue_work(uv_default_loop(), &baton->request, SetReportWork, SetReportAfter);
+
+	return scope.Close(returnValue);
+};
+
+void Aquastream::SetReportWork(uv_work_t *request) {
+
+	ReportBaton *baton = static_cast<ReportBaton*>(request->data);
+
+	IO::pumpSettingsReport values = baton->settings;
+
+	baton->error = baton->aquastream->device->writeSettings(&values, &baton->mask, &baton->before, &baton->settings);
+};
+
+void Aquastream::SetReportAfter(uv_work_t *request, int status) {
+
+	HandleScope scope;
+
+	ReportBaton *baton = static_cast<ReportBaton*>(request->data);
+
+	if (baton->error < 0) {
+		Async::complete(baton->callback, Async::error(IO::errorString(baton->error)), Undefined());
+	} else {
+		Async::complete(baton->callback, Null(), Schema::changed(
+			IO::SETTINGS_REPORT,
+			(const unsigned char*) &baton->before,
+			(const unsigned char*) &baton->settings
+		));
+	}
+
+	baton->aquastream->Unref();
+	baton->callback.Dispose();
+	delete baton;
+};
+
+/**
+ * getDeviceInfo([callback])
+ *
+ * Callback gets (err, info). Returns a Promise if no callback is given.
+ */
+Handle<Value> Aquastream::GetDeviceInfo(const Arguments& args) {
+
+	HandleScope scope;
+
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(args[0], &returnValue);
+
+	if (cb.IsEmpty())
+		return scope.Close(Undefined());
+
+	Aquastream* aquastream 	= ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	DeviceInfoBaton *baton = new DeviceInfoBaton();
+	baton->request.data = baton;
+	baton->aquastream = aquastream;
+	baton->callback = Persistent<Function>::New(cb);
+
+	aquastream->Ref();
+	uv_queue_work(uv_default_loop(), &baton->request, GetDeviceInfoWork, GetDeviceInfoAfter);
+
+	return scope.Close(returnValue);
+};
+
+void Aquastream::GetDeviceInfoWork(uv_work_t *request) {
+
+	DeviceInfoBaton *baton = static_cast<DeviceInfoBaton*>(request->data);
+
+	baton->aquastream->device->getDevicePath(baton->devicePath, sizeof(baton->devicePath));
+};
+
+void Aquastream::GetDeviceInfoAfter(uv_work_t *request, int status) {
+
+	HandleScope scope;
+
+	DeviceInfoBaton *baton = static_cast<DeviceInfoBaton*>(request->data);
+
+	Async::complete(baton->callback, Null(), IO::getDeviceInfo(baton->devicePath));
+
+	baton->aquastream->Unref();
+	baton->callback.Dispose();
+	delete baton;
+};
+
+/**
+ * getRawReport(reportId, [callback])
+ *
+ * Callback gets (err, buffer) with the packed report struct, see
+ * getReportLayout() for the offsets. Returns a Promise if no callback is given.
+ */
+Handle<Value> Aquastream::GetRawReport(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (args.Length() < 1) {
+		ThrowException(Exception::TypeError(String::New("Wrong number of arguments")));
+		return scope.Close(Undefined());
+	}
+
+	if (!args[0]->IsNumber()) {
+		ThrowException(Exception::TypeError(String::New("Invalid Feature Report ID")));
+		return scope.Close(Undefined());
+	}
+
+	int reportId = args[0]->NumberValue();
+	size_t length;
 
 	switch(reportId) {
-		case 6:
-			returnValue = IO::setSettings(Number::New(aquastream->handle), Number::New(reportId), data);
+		case IO::DATA_REPORT:
+			length = sizeof(IO::pumpDataReport);
 		break;
-		default:
-			returnValue = Number::New(-1);
+		case IO::SETTINGS_REPORT:
+			length = sizeof(IO::pumpSettingsReport);
 		break;
+		default:
+			ThrowException(Exception::TypeError(String::New("Invalid Feature Report ID")));
+			return scope.Close(Undefined());
 	}
 
-	//return returnValue;
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(args[1], &returnValue);
+
+	if (cb.IsEmpty())
+		return scope.Close(Undefined());
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+	node::Buffer *buffer = node::Buffer::New(length);
+
+	RawReportBaton *baton = new RawReportBaton();
+	baton->request.data = baton;
+	baton->aquastream = aquastream;
+	baton->callback = Persistent<Function>::New(cb);
+	baton->buffer = Persistent<Object>::New(buffer->handle_);
+	baton->data = (unsigned char*) node::Buffer::Data(buffer->handle_);
+	baton->length = length;
+	baton->reportId = reportId;
+	baton->error = 0;
+
+	aquastream->Ref();
+	uv_queue_work(uv_default_loop(), &baton->request, GetRawReportWork, GetRawReportAfter);
+
 	return scope.Close(returnValue);
 };
 
+void Aquastream::GetRawReportWork(uv_work_t *request) {
 
-Handle<Value> Aquastream::GetDeviceInfo(const Arguments& args) {
+	RawReportBaton *baton = static_cast<RawReportBaton*>(request->data);
+
+	baton->error = baton->aquastream->device->readReport(baton->reportId, baton->data, baton->length);
+};
+
+void Aquastream::GetRawReportAfter(uv_work_t *request, int status) {
 
 	HandleScope scope;
 
-	Aquastream* aquastream 	= ObjectWrap::Unwrap<Aquastream>(args.This());
+	RawReportBaton *baton = static_cast<RawReportBaton*>(request->data);
+
+	if (baton->error < 0) {
+		Async::complete(baton->callback, Async::error(IO::errorString(baton->error)), Undefined());
+	} else {
+		Async::complete(baton->callback, Null(), baton->buffer);
+	}
+
+	baton->aquastream->Unref();
+	baton->callback.Dispose();
+	baton->buffer.Dispose();
+	delete baton;
+};
+
+/**
+ * Aquastream.getReportLayout(reportId)
+ *
+ * Returns the offsets of the fields in a raw report
+ */
+Handle<Value> Aquastream::GetReportLayout(const Arguments& args) {
 
-	// get info
-	Handle<Object> info = IO::getDeviceInfo(Number::New(aquastream->handle));
+	HandleScope scope;
+
+	if (!args[0]->IsNumber()) {
+		ThrowException(Exception::TypeError(String::New("Invalid Feature Report ID")));
+		return scope.Close(Undefined());
+	}
+
+	return scope.Close(IO::getReportLayout(args[0]->Int32Value()));
+};
+
+/**
+ * startSampling({ intervalMs, batchSize, capacity, deadbands }, callback)
+ *
+ * Polls the data report on a native thread, callback gets (err, samples)
+ * once per batch. Up to capacity samples are buffered while JS is busy,
+ * older ones are dropped.
+ *
+ * With minIntervalMs and maxIntervalMs instead of intervalMs the interval
+ * adapts: the minimum while water temperature, flow or pump current change
+ * faster than rateThresholds { temperature (°C/s), flow, pumpCurrent (%/s) }
+ * or an alarm is set, growing towards the maximum while they are stable.
+ *
+ * With deadbands, e.g. { 'current.temperature': 0.1, 'current.fanRpm': 20 },
+ * only reports where a listed field moved by its deadband or an alarm bit
+ * flipped are delivered, with just the changed fields.
+ */
+Handle<Value> Aquastream::StartSampling(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (args.Length() < 2) {
+		ThrowException(Exception::TypeError(String::New("Wrong number of arguments")));
+		return scope.Close(Undefined());
+	}
+
+	if (!args[0]->IsObject() || !args[1]->IsFunction()) {
+		ThrowException(Exception::TypeError(String::New("Invalid arguments")));
+		return scope.Close(Undefined());
+	}
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (aquastream->sampler) {
+		ThrowException(Exception::Error(String::New("Already sampling")));
+		return scope.Close(Undefined());
+	}
+
+	Local<Object> options = args[0]->ToObject();
+	Local<Value> intervalMs = options->Get(String::NewSymbol("intervalMs"));
+	Local<Value> batchSize = options->Get(String::NewSymbol("batchSize"));
+	Local<Value> capacity = options->Get(String::NewSymbol("capacity"));
+	Local<Value> minIntervalMs = options->Get(String::NewSymbol("minIntervalMs"));
+	Local<Value> maxIntervalMs = options->Get(String::NewSymbol("maxIntervalMs"));
+	Local<Value> rateThresholds = options->Get(String::NewSymbol("rateThresholds"));
+
+	Local<Value> deadbands = options->Get(String::NewSymbol("deadbands"));
+	Deadband *deadband = NULL;
+
+	AdaptiveInterval::Thresholds thresholds = AdaptiveInterval::DEFAULT_THRESHOLDS;
+	bool adaptive = !minIntervalMs->IsUndefined() || !maxIntervalMs->IsUndefined();
+
+	if (adaptive) {
+
+		if (!minIntervalMs->IsNumber() || !maxIntervalMs->IsNumber() || minIntervalMs->Uint32Value() == 0 ||
+			maxIntervalMs->Uint32Value() < minIntervalMs->Uint32Value()) {
+			ThrowException(Exception::TypeError(String::New("Invalid minIntervalMs or maxIntervalMs")));
+			return scope.Close(Undefined());
+		}
+
+		if (rateThresholds->IsObject()) {
+
+			Local<Object> object = rateThresholds->ToObject();
+			Local<Value> temperature = object->Get(String::NewSymbol("temperature"));
+			Local<Value> flow = object->Get(String::NewSymbol("flow"));
+			Local<Value> pumpCurrent = object->Get(String::NewSymbol("pumpCurrent"));
+
+			if (temperature->IsNumber())
+				thresholds.temperature = temperature->NumberValue();
+
+			if (flow->IsNumber())
+				thresholds.flow = flow->NumberValue();
+
+			if (pumpCurrent->IsNumber())
+				thresholds.pumpCurrent = pumpCurrent->NumberValue();
+
+		} else if (!rateThresholds->IsUndefined()) {
+			ThrowException(Exception::TypeError(String::New("Invalid rateThresholds")));
+			return scope.Close(Undefined());
+		}
+
+	} else if (!intervalMs->IsNumber() || intervalMs->Uint32Value() == 0) {
+		ThrowException(Exception::TypeError(String::New("Invalid intervalMs")));
+		return scope.Close(Undefined());
+	}
+
+	uint32_t ringCapacity = capacity->IsNumber() ? capacity->Uint32Value() : 1024;
+
+	// the ring is allocated up front, its allocation failing would abort
+	if (ringCapacity == 0 || ringCapacity > Sampler::MAX_CAPACITY) {
+		ThrowException(Exception::RangeError(String::New("Invalid capacity")));
+		return scope.Close(Undefined());
+	}
+
+	uint32_t samplesPerBatch = batchSize->IsNumber() ? batchSize->Uint32Value() : 1;
+
+	// a larger batch would be overwritten in the ring before it is signaled
+	if (samplesPerBatch > ringCapacity) {
+		ThrowException(Exception::RangeError(String::New("batchSize exceeds capacity")));
+		return scope.Close(Undefined());
+	}
+
+	if (deadbands->IsObject()) {
+
+		std::string error;
+		deadband = Deadband::compile(deadbands->ToObject(), &error);
+
+		if (!deadband) {
+			ThrowException(Exception::TypeError(String::New(("Invalid deadband " + error).c_str())));
+			return scope.Close(Undefined());
+		}
+	}
+
+	aquastream->sampler = new Sampler(
+		aquastream,
+		adaptive ? minIntervalMs->Uint32Value() : intervalMs->Uint32Value(),
+		samplesPerBatch,
+		ringCapacity,
+		deadband,
+		adaptive ? new AdaptiveInterval(
+			(uint64_t) minIntervalMs->Uint32Value() * 1000000,
+			(uint64_t) maxIntervalMs->Uint32Value() * 1000000,
+			thresholds
+		) : NULL,
+		Local<Function>::Cast(args[1])
+	);
+
+	aquastream->Ref();
+	aquastream->sampler->start();
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * stopSampling()
+ *
+ * Stops the sampler, samples not yet delivered are passed to the callback.
+ */
+Handle<Value> Aquastream::StopSampling(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	// stop() delivers the remaining samples, their callback may call stopSampling() again
+	Sampler *sampler = aquastream->sampler;
+
+	if (sampler) {
+		aquastream->sampler = NULL;
+		sampler->stop();
+	}
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * getSamplingStatus()
+ *
+ * Returns { running, buffered, dropped, capacity, intervalMs, rate }, the
+ * interval currently used and the reads per second it amounts to
+ */
+Handle<Value> Aquastream::GetSamplingStatus(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (!aquastream->sampler) {
+		Local<Object> status = Object::New();
+		status->Set(String::NewSymbol("running"), False());
+		return scope.Close(status);
+	}
+
+	return scope.Close(aquastream->sampler->getStatus());
+};
+
+/**
+ * watchAlarms(listener)
+ *
+ * Listener gets (err, { timestamp, changes }) with the alarm bits that
+ * flipped, e.g. { 'alarm.flow': 1 }, first with the current state. Events
+ * come from the device node instead of polling, the pump signals alarms
+ * with tacho.mode.linkAlarmInterrupt set.
+ */
+Handle<Value> Aquastream::WatchAlarms(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (!args[0]->IsFunction()) {
+		ThrowException(Exception::TypeError(String::New("Invalid listener")));
+		return scope.Close(Undefined());
+	}
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (!aquastream->alarms) {
+
+		aquastream->alarms = Alarms::open(aquastream);
+
+		if (!aquastream->alarms) {
+			ThrowException(Exception::Error(String::New("Couldn't watch the device")));
+			return scope.Close(Undefined());
+		}
+	}
+
+	aquastream->alarms->addListener(Local<Function>::Cast(args[0]));
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * unwatchAlarms([listener])
+ *
+ * Removes a listener or all of them, the device is no longer watched once
+ * none are left.
+ */
+Handle<Value> Aquastream::UnwatchAlarms(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (aquastream->alarms && aquastream->alarms->removeListener(args[0])) {
+		aquastream->alarms->stop();
+		aquastream->alarms = NULL;
+	}
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * enableHistory({ capacity })
+ *
+ * Keeps the last capacity data reports read by getReport(4) or the sampler,
+ * at most History::MAX_CAPACITY.
+ */
+Handle<Value> Aquastream::EnableHistory(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+	size_t capacity = 86400;
+
+	if (args[0]->IsObject()) {
+		Local<Value> value = args[0]->ToObject()->Get(String::NewSymbol("capacity"));
+
+		if (value->IsNumber())
+			capacity = value->Uint32Value();
+	}
+
+	// the columns are allocated up front
+	if (capacity == 0 || capacity > History::MAX_CAPACITY) {
+		ThrowException(Exception::RangeError(String::New("Invalid capacity")));
+		return scope.Close(Undefined());
+	}
+
+	History *history = History::create(capacity);
+
+	if (!history) {
+		ThrowException(Exception::Error(String::New("Couldn't allocate history")));
+		return scope.Close(Undefined());
+	}
+
+	delete aquastream->history;
+	aquastream->history = history;
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * disableHistory()
+ */
+Handle<Value> Aquastream::DisableHistory(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	delete aquastream->history;
+	aquastream->history = NULL;
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * queryHistory({ from, to, step, agg })
+ *
+ * from / to are sample timestamps in ms (defaults to the whole history),
+ * step is the bucket size in ms, agg one of 'min', 'max', 'mean' (default)
+ * or 'last'. Returns { timestamp: Float64Array, <field>: Float64Array, ... }
+ */
+Handle<Value> Aquastream::QueryHistory(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (!aquastream->history) {
+		ThrowException(Exception::Error(String::New("History is not enabled")));
+		return scope.Close(Undefined());
+	}
+
+	if (!args[0]->IsObject()) {
+		ThrowException(Exception::TypeError(String::New("Invalid arguments")));
+		return scope.Close(Undefined());
+	}
+
+	Local<Object> options = args[0]->ToObject();
+	Local<Value> from = options->Get(String::NewSymbol("from"));
+	Local<Value> to = options->Get(String::NewSymbol("to"));
+	Local<Value> step = options->Get(String::NewSymbol("step"));
+	Local<Value> agg = options->Get(String::NewSymbol("agg"));
+
+	if (!step->IsNumber() || step->NumberValue() <= 0) {
+		ThrowException(Exception::TypeError(String::New("Invalid step")));
+		return scope.Close(Undefined());
+	}
+
+	int aggregate = History::AGGREGATE_MEAN;
+
+	if (agg->IsString()) {
+		aggregate = History::aggregateType(*String::AsciiValue(agg));
+
+		if (aggregate < 0) {
+			ThrowException(Exception::TypeError(String::New("Invalid agg")));
+			return scope.Close(Undefined());
+		}
+	}
+
+	History *history = aquastream->history;
+
+	uint64_t start = from->IsNumber() ? (uint64_t)(from->NumberValue() * 1e6) : history->first();
+	uint64_t end = to->IsNumber() ? (uint64_t)(to->NumberValue() * 1e6) : history->last() + 1;
+
+	IO::pumpSettingsReport settings;
+	aquastream->device->cachedSettings(&settings);
+
+	return scope.Close(history->query(start, end, (uint64_t)(step->NumberValue() * 1e6), aggregate, &settings));
+};
+
+/**
+ * Aquastream.enumerate(vendorId, productId)
+ *
+ * Returns the device paths of all matching devices
+ */
+Handle<Value> Aquastream::Enumerate(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (!args[0]->IsNumber() || !args[1]->IsNumber()) {
+		ThrowException(Exception::TypeError(String::New("Invalid vendor or product id")));
+		return scope.Close(Undefined());
+	}
+
+	std::vector<std::string> paths;
+	Device::enumerate(args[0]->Int32Value(), args[1]->Int32Value(), Device::TRANSPORT_AUTO, &paths);
+
+	Local<Array> devices = Array::New(paths.size());
+
+	for (size_t i = 0; i < paths.size(); i++)
+		devices->Set(i, String::New(paths[i].c_str()));
+
+	return scope.Close(devices);
+};
+
+/**
+ * Maps a CLOCK_MONOTONIC time to CLOCK_REALTIME
+ * @param uint64_t timestamp ns
+ * @return uint64_t ns
+ */
+static uint64_t wallClock(uint64_t timestamp) {
+
+	struct timespec realtime;
+	clock_gettime(CLOCK_REALTIME, &realtime);
+
+	return (uint64_t) realtime.tv_sec * 1000000000 + realtime.tv_nsec - (Sampler::now() - timestamp);
+};
+
+/**
+ * Hands a data report read by getReport(4), the sampler or the alarm
+ * watcher to history, recording, publishing and metrics
+ * @param uint64_t timestamp CLOCK_MONOTONIC in ns
+ * @param const IO::pumpDataReport *data
+ */
+void Aquastream::sampled(uint64_t timestamp, const IO::pumpDataReport *data) {
+
+	if (history)
+		history->append(timestamp, data);
+
+	// recordings and other processes outlive this one, so they get wall clock time
+	if (recorder || publisher) {
+
+		IO::pumpSettingsReport settings;
+		uint64_t time = wallClock(timestamp);
+
+		device->cachedSettings(&settings);
+
+		if (recorder)
+			record(time, data, &settings);
+
+		if (publisher)
+			publisher->publish(time, data, &settings);
+	}
+
+	if (timestamp >= latestTime) {
+		memcpy(&latest, data, sizeof(latest));
+		latestTime = timestamp;
+	}
+};
+
+/**
+ * getMetricsText([options], [callback])
+ *
+ * Callback gets (err, text) with the last data report and the relevant
+ * settings in OpenMetrics text format, labeled with serial and devicePath.
+ * The device is only read if there is no sample younger than
+ * options.maxAge ms (default 10000). Returns a Promise if no callback is
+ * given.
+ */
+Handle<Value> Aquastream::GetMetricsText(const Arguments& args) {
+
+	HandleScope scope;
+
+	Handle<Value> callback = args[0];
+	uint64_t maxAge = 10000000000ULL;
+
+	if (args[0]->IsObject() && !args[0]->IsFunction()) {
+
+		Local<Value> value = args[0]->ToObject()->Get(String::NewSymbol("maxAge"));
+
+		if (value->IsNumber())
+			maxAge = (uint64_t)(value->NumberValue() * 1e6);
+
+		callback = args[1];
+	}
+
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(callback, &returnValue);
+
+	if (cb.IsEmpty())
+		return scope.Close(Undefined());
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	// a fresh sample is formatted right away, without a baton or the threadpool
+	if (aquastream->latestTime && Sampler::now() - aquastream->latestTime <= maxAge) {
+		Async::defer(cb, Null(), aquastream->metricsText());
+		return scope.Close(returnValue);
+	}
+
+	ReportBaton *baton = new ReportBaton();
+	baton->request.data = baton;
+	baton->aquastream = aquastream;
+	baton->callback = Persistent<Function>::New(cb);
+	baton->reportId = IO::DATA_REPORT;
+	baton->projection = NULL;
+	baton->error = 0;
+
+	aquastream->Ref();
+
+	uv_queue_work(uv_default_loop(), &baton->request, GetMetricsTextWork, GetMetricsTextAfter);
+
+	return scope.Close(returnValue);
+};
+
+void Aquastream::GetMetricsTextWork(uv_work_t *request) {
+
+	ReportBaton *baton = static_cast<ReportBaton*>(request->data);
+
+	baton->error = baton->aquastream->device->readData(&baton->data, &baton->settings);
+	baton->timestamp = Sampler::now();
+};
+
+void Aquastream::GetMetricsTextAfter(uv_work_t *request, int status) {
+
+	HandleScope scope;
+
+	ReportBaton *baton = static_cast<ReportBaton*>(request->data);
+	Aquastream *aquastream = baton->aquastream;
+
+	if (baton->error < 0) {
+		Async::complete(baton->callback, Async::error(IO::errorString(baton->error)), Undefined());
+	} else {
+		aquastream->sampled(baton->timestamp, &baton->data);
+
+		Async::complete(baton->callback, Null(), aquastream->metricsText());
+	}
+
+	aquastream->Unref();
+	baton->callback.Dispose();
+	delete baton;
+};
+
+/**
+ * Formats the last data report with the cached settings, into the buffer
+ * kept by the instance
+ * @return Local<String>
+ */
+Local<String> Aquastream::metricsText() {
+
+	IO::pumpSettingsReport settings;
+	char devicePath[PATH_MAX];
+	size_t length;
+
+	device->cachedSettings(&settings);
+
+	if (device->getDevicePath(devicePath, sizeof(devicePath)) < 0)
+		devicePath[0] = 0;
+
+	if (!metrics)
+		metrics = new Metrics();
+
+	const char *text = metrics->format(&latest, &settings, devicePath, wallClock(latestTime), &length);
+
+	return String::New(text, length);
+};
+
+/**
+ * Appends a data report to the recording, stops recording if a new
+ * segment can't be created
+ * @param uint64_t timestamp CLOCK_REALTIME in ns
+ * @param const IO::pumpDataReport *data
+ * @param const IO::pumpSettingsReport *settings
+ */
+void Aquastream::record(uint64_t timestamp, const IO::pumpDataReport *data, const IO::pumpSettingsReport *settings) {
+
+	recorder->setSettings(settings);
+
+	if (!recorder->append(timestamp, data)) {
+		delete recorder;
+		recorder = NULL;
+	}
+};
+
+/**
+ * startRecording({ path, segmentRecords })
+ *
+ * Appends every data report read by getReport(4) or the sampler to the
+ * recording in the directory path, see doc/recording-format.md. An
+ * existing recording is continued.
+ */
+Handle<Value> Aquastream::StartRecording(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (!args[0]->IsObject()) {
+		ThrowException(Exception::TypeError(String::New("Invalid arguments")));
+		return scope.Close(Undefined());
+	}
+
+	Local<Object> options = args[0]->ToObject();
+	Local<Value> path = options->Get(String::NewSymbol("path"));
+	Local<Value> segmentRecords = options->Get(String::NewSymbol("segmentRecords"));
+
+	if (!path->IsString()) {
+		ThrowException(Exception::TypeError(String::New("Invalid path")));
+		return scope.Close(Undefined());
+	}
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+	IO::pumpSettingsReport settings;
+
+	aquastream->device->cachedSettings(&settings);
+
+	Recorder *recorder = Recorder::open(
+		*String::Utf8Value(path),
+		segmentRecords->IsNumber() ? segmentRecords->Uint32Value() : Recorder::DEFAULT_CAPACITY,
+		&settings
+	);
+
+	if (!recorder) {
+		ThrowException(Exception::Error(String::New("Couldn't open recording")));
+		return scope.Close(Undefined());
+	}
+
+	delete aquastream->recorder;
+	aquastream->recorder = recorder;
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * stopRecording()
+ */
+Handle<Value> Aquastream::StopRecording(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	delete aquastream->recorder;
+	aquastream->recorder = NULL;
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * Reader behind the Buffers of a readRecording() result, unmapped once
+ * the last of them is collected
+ */
+struct RecordingBuffers {
+	RecordingReader *reader;
+	size_t count;
+};
+
+static void releaseRecording(char *data, void *hint) {
+
+	RecordingBuffers *buffers = static_cast<RecordingBuffers*>(hint);
+
+	if (--buffers->count == 0) {
+		delete buffers->reader;
+		delete buffers;
+	}
+};
+
+/**
+ * Aquastream.readRecording(path, [{ from, to }])
+ *
+ * from / to are ms since the epoch, defaulting to the whole recording.
+ * Returns [{ records: Buffer, settings: Buffer }, ...], one entry per
+ * segment in range. records is the mapped segment itself: 80 byte records
+ * of a uint64 timestamp (ns) and the data report, see
+ * doc/recording-format.md. settings is the settings report to decode them
+ * with.
+ */
+Handle<Value> Aquastream::ReadRecording(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (!args[0]->IsString()) {
+		ThrowException(Exception::TypeError(String::New("Invalid path")));
+		return scope.Close(Undefined());
+	}
+
+	uint64_t from = 0, to = (uint64_t) -1;
+
+	if (args[1]->IsObject()) {
+
+		Local<Object> options = args[1]->ToObject();
+		Local<Value> value;
+
+		if ((value = options->Get(String::NewSymbol("from")))->IsNumber())
+			from = (uint64_t)(value->NumberValue() * 1e6);
+
+		if ((value = options->Get(String::NewSymbol("to")))->IsNumber())
+			to = (uint64_t)(value->NumberValue() * 1e6);
+	}
+
+	RecordingReader *reader = RecordingReader::open(*String::Utf8Value(args[0]));
+
+	if (!reader) {
+		ThrowException(Exception::Error(String::New("Couldn't read recording")));
+		return scope.Close(Undefined());
+	}
+
+	RecordingBuffers *buffers = new RecordingBuffers();
+	buffers->reader = reader;
+	buffers->count = 1;
+
+	RecordingPosition position = reader->seek(from);
+	const RecordingRecord *records;
+	size_t count;
+
+	Local<Array> result = Array::New();
+
+	while ((records = reader->span(&position, to, &count))) {
+
+		IO::pumpSettingsReport settings;
+		reader->settings(position.segment, &settings);
+
+		buffers->count++;
+
+		node::Buffer *recordsBuffer = node::Buffer::New(
+			(char*) records,
+			count * sizeof(RecordingRecord),
+			releaseRecording,
+			buffers
+		);
+
+		node::Buffer *settingsBuffer = node::Buffer::New((char*) &settings, sizeof(settings));
+
+		Local<Object> segment = Object::New();
+		segment->Set(String::NewSymbol("records"), recordsBuffer->handle_);
+		segment->Set(String::NewSymbol("settings"), settingsBuffer->handle_);
+
+		result->Set(result->Length(), segment);
+	}
+
+	// drops the reference held while building, frees the reader if unused
+	releaseRecording(NULL, buffers);
+
+	return scope.Close(result);
+};
+
+/**
+ * startPublishing({ name })
+ *
+ * Publishes every data report read by getReport(4), the sampler or the
+ * alarm watcher to the shared memory segment name (default
+ * "/aquastreamxt"), for AquastreamReader in other processes.
+ */
+Handle<Value> Aquastream::StartPublishing(const Arguments& args) {
+
+	HandleScope scope;
+
+	std::string name = "/aquastreamxt";
+
+	if (args[0]->IsObject()) {
+
+		Local<Value> value = args[0]->ToObject()->Get(String::NewSymbol("name"));
+
+		if (value->IsString())
+			name = *String::Utf8Value(value);
+	}
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	std::string error;
+
+	// our own lock would keep us from reopening the name
+	delete aquastream->publisher;
+	aquastream->publisher = SharedPublisher::open(name.c_str(), &error);
+
+	if (!aquastream->publisher) {
+		ThrowException(Exception::Error(String::New(error.c_str())));
+		return scope.Close(Undefined());
+	}
+
+	// readers get the last sample right away
+	if (aquastream->latestTime) {
+
+		IO::pumpSettingsReport settings;
+		aquastream->device->cachedSettings(&settings);
+
+		aquastream->publisher->publish(wallClock(aquastream->latestTime), &aquastream->latest, &settings);
+	}
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * stopPublishing()
+ *
+ * Removes the segment, readers that have it open keep the last sample.
+ */
+Handle<Value> Aquastream::StopPublishing(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	delete aquastream->publisher;
+	aquastream->publisher = NULL;
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * startBroker({ path })
+ *
+ * Serves the reports of this device to AquastreamClients of other
+ * processes over the Unix socket path, by default aquastreamxt.sock in
+ * $XDG_RUNTIME_DIR or a private directory in /tmp, see Broker::defaultPath.
+ * Concurrent requests for a report share one read.
+ */
+Handle<Value> Aquastream::StartBroker(const Arguments& args) {
+
+	HandleScope scope;
+
+	std::string path, error;
+	Local<Value> value;
+
+	if (args[0]->IsObject())
+		value = args[0]->ToObject()->Get(String::NewSymbol("path"));
+
+	if (!value.IsEmpty() && value->IsString()) {
+		path = *String::Utf8Value(value);
+	} else if (!Broker::defaultPath(&path, &error)) {
+		ThrowException(Exception::Error(String::New(error.c_str())));
+		return scope.Close(Undefined());
+	}
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (aquastream->broker) {
+		ThrowException(Exception::Error(String::New("Broker already started")));
+		return scope.Close(Undefined());
+	}
+
+	aquastream->broker = Broker::open(aquastream, path.c_str(), &error);
+
+	if (!aquastream->broker) {
+		ThrowException(Exception::Error(String::New(error.c_str())));
+		return scope.Close(Undefined());
+	}
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * stopBroker()
+ *
+ * Closes the socket and all client connections
+ */
+Handle<Value> Aquastream::StopBroker(const Arguments& args) {
+
+	HandleScope scope;
+
+	Aquastream* aquastream = ObjectWrap::Unwrap<Aquastream>(args.This());
+
+	if (aquastream->broker) {
+		aquastream->broker->stop();
+		aquastream->broker = NULL;
+	}
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * Aquastream.getStats()
+ *
+ * Returns count, errors and p50/p99/max latency in ns of every ioctl and
+ * report conversion since the last resetStats()
+ */
+Handle<Value> Aquastream::GetStats(const Arguments& args) {
+
+	HandleScope scope;
+
+	return scope.Close(Stats::get());
+};
+
+/**
+ * Aquastream.resetStats()
+ */
+Handle<Value> Aquastream::ResetStats(const Arguments& args) {
+
+	HandleScope scope;
 
-	Local<Function> cb = Local<Function>::Cast(args[0]);
-	const unsigned argc = 1;
-	Local<Value> argv[argc] = { Local<Object>::New(info) };
-	cb->Call(Context::GetCurrent()->Global(), argc, argv);
+	Stats::reset();
 
 	return scope.Close(Undefined());
 };
 
 void InitAll(Handle<Object> target) {
 	Aquastream::Init(target);
+	AquastreamGroup::Init(target);
+	AquastreamReader::Init(target);
+	AquastreamClient::Init(target);
 };
 
-NODE_MODULE(aquastreamxt_api, InitAll)
\ No newline at end of file
+NODE_MODULE(aquastreamxt_api, InitAll)
@@ -7,6 +7,19 @@
 #define AQUASTREAMXT_H
 
 #include <node.h>
+#include <uv.h>
+#include <map>
+#include <string>
+#include "io.h"
+#include "device.h"
+
+class Sampler;
+class History;
+class Alarms;
+class Recorder;
+class Metrics;
+class SharedPublisher;
+class Broker;
 
 class Aquastream: public node::ObjectWrap {
 
@@ -14,6 +27,10 @@ class Aquastream: public node::ObjectWrap {
 		static void Init(v8::Handle<v8::Object> target);
 
 	private:
+		friend class Sampler;
+		friend class Alarms;
+		friend class Broker;
+
 		Aquastream();
 		~Aquastream();
 
@@ -21,11 +38,77 @@ class Aquastream: public node::ObjectWrap {
 	static v8::Handle<v8::Value> GetReport(const v8::Arguments& args);
 	static v8::Handle<v8::Value> SetReport(const v8::Arguments& args);
 	static v8::Handle<v8::Value> GetDeviceInfo(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetRawReport(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetReportLayout(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Enumerate(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetStats(const v8::Arguments& args);
+	static v8::Handle<v8::Value> ResetStats(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StartSampling(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StopSampling(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetSamplingStatus(const v8::Arguments& args);
+	static v8::Handle<v8::Value> WatchAlarms(const v8::Arguments& args);
+	static v8::Handle<v8::Value> UnwatchAlarms(const v8::Arguments& args);
+	static v8::Handle<v8::Value> EnableHistory(const v8::Arguments& args);
+	static v8::Handle<v8::Value> DisableHistory(const v8::Arguments& args);
+	static v8::Handle<v8::Value> QueryHistory(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StartRecording(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StopRecording(const v8::Arguments& args);
+	static v8::Handle<v8::Value> ReadRecording(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetMetricsText(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StartPublishing(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StopPublishing(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StartBroker(const v8::Arguments& args);
+	static v8::Handle<v8::Value> StopBroker(const v8::Arguments& args);
+
+	void record(uint64_t timestamp, const IO::pumpDataReport *data, const IO::pumpSettingsReport *settings);
+	void sampled(uint64_t timestamp, const IO::pumpDataReport *data);
+	v8::Local<v8::String> metricsText();
+
+	// run on the libuv threadpool
+	static void GetReportWork(uv_work_t *request);
+	static void SetReportWork(uv_work_t *request);
+	static void GetDeviceInfoWork(uv_work_t *request);
+	static void GetRawReportWork(uv_work_t *request);
+	static void GetMetricsTextWork(uv_work_t *request);
+
+	// run on the event loop once the work is done
+	static void GetReportAfter(uv_work_t *request, int status);
+	static void SetReportAfter(uv_work_t *request, int status);
+	static void GetDeviceInfoAfter(uv_work_t *request, int status);
+	static void GetRawReportAfter(uv_work_t *request, int status);
+	static void GetMetricsTextAfter(uv_work_t *request, int status);
 
 	int vendorId;
 	int productId;
-	int handle;
+
+	Device *device;
+
+	// background sampler, NULL unless sampling
+	Sampler *sampler;
+
+	// alarm listeners, NULL unless watching
+	Alarms *alarms;
+
+	// serves other processes over a Unix socket, NULL unless started
+	Broker *broker;
+
+	// time series of data reports, NULL unless enabled, event loop only
+	History *history;
+
+	// appends data reports to a recording, NULL unless recording, event loop only
+	Recorder *recorder;
+
+	// last data report read by any caller and its CLOCK_MONOTONIC time in ns,
+	// 0 = none yet, event loop only
+	IO::pumpDataReport latest;
+	uint64_t latestTime;
+
+	// shared memory segment for other processes, NULL unless publishing, event loop only
+	SharedPublisher *publisher;
+
+	// OpenMetrics text buffer, NULL until the first getMetricsText()
+	Metrics *metrics;
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,125 @@
+/**
+ * Helpers for callback / Promise based async functions
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <v8.h>
+
+#include "async.h"
+
+using namespace v8;
+
+/**
+ * Returns the function to call on completion
+ *
+ * If callback isn't a function a Promise is created and stored in promise,
+ * the returned function settles it Node style (err, result).
+ *
+ * @param Handle<Value> callback
+ * @param Local<Value> *promise
+ * @return Local<Function> Empty if Promises aren't available
+ */
+Local<Function> Async::callback(Handle<Value> callback, Local<Value> *promise) {
+
+	if (callback->IsFunction())
+		return Local<Function>::Cast(callback);
+
+	Local<Value> constructor = Context::GetCurrent()->Global()->Get(String::NewSymbol("Promise"));
+
+	if (!constructor->IsFunction()) {
+		ThrowException(Exception::TypeError(String::New("Callback required, Promise is not available")));
+		return Local<Function>();
+	}
+
+	Local<Object> deferred = Object::New();
+
+	const unsigned argc = 1;
+	Local<Value> argv[argc] = { FunctionTemplate::New(Capture, deferred)->GetFunction() };
+	*promise = Local<Function>::Cast(constructor)->NewInstance(argc, argv);
+
+	return FunctionTemplate::New(Settle, deferred)->GetFunction();
+};
+
+/**
+ * Calls a completion callback from the event loop
+ * @param Handle<Function> callback
+ * @param Handle<Value> error
+ * @param Handle<Value> result
+ */
+void Async::complete(Handle<Function> callback, Handle<Value> error, Handle<Value> result) {
+
+	HandleScope scope;
+
+	const unsigned argc = 2;
+	Handle<Value> argv[argc] = { error, result };
+
+	node::MakeCallback(Context::GetCurrent()->Global(), callback, argc, argv);
+};
+
+/**
+ * Calls a completion callback on the next tick, for results that are
+ * known before the async function returns
+ * @param Handle<Function> callback
+ * @param Handle<Value> error
+ * @param Handle<Value> result
+ */
+void Async::defer(Handle<Function> callback, Handle<Value> error, Handle<Value> result) {
+
+	HandleScope scope;
+
+	Local<Object> process = Context::GetCurrent()->Global()->Get(String::NewSymbol("process"))->ToObject();
+	Local<Function> nextTick = Local<Function>::Cast(process->Get(String::NewSymbol("nextTick")));
+	Local<Function> bind = Local<Function>::Cast(callback->Get(String::NewSymbol("bind")));
+
+	Handle<Value> bindArgv[3] = { Null(), error, result };
+	Handle<Value> argv[1] = { bind->Call(callback, 3, bindArgv) };
+
+	nextTick->Call(process, 1, argv);
+};
+
+/**
+ * Creates an Error object
+ * @param const char *message
+ * @return Local<Value>
+ */
+Local<Value> Async::error(const char *message) {
+	return Exception::Error(String::New(message));
+};
+
+/**
+ * Promise executor, keeps resolve and reject
+ */
+Handle<Value> Async::Capture(const Arguments& args) {
+
+	HandleScope scope;
+
+	Local<Object> deferred = args.Data()->ToObject();
+	deferred->Set(String::NewSymbol("resolve"), args[0]);
+	deferred->Set(String::NewSymbol("reject"), args[1]);
+
+	return scope.Close(Undefined());
+};
+
+/**
+ * Node style callback settling the Promise
+ */
+Handle<Value> Async::Settle(const Arguments& args) {
+
+	HandleScope scope;
+
+	Local<Object> deferred = args.Data()->ToObject();
+	bool failed = !args[0]->IsUndefined() && !args[0]->IsNull();
+
+	Local<Function> settle = Local<Function>::Cast(
+		deferred->Get(String::NewSymbol(failed ? "reject" : "resolve"))
+	);
+
+	const unsigned argc = 1;
+	Local<Value> argv[argc] = { failed ? args[0] : args[1] };
+	settle->Call(Context::GetCurrent()->Global(), argc, argv);
+
+	return scope.Close(Undefined());
+};
@@ -0,0 +1,29 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <v8.h>
+
+using namespace v8;
+
+class Async {
+
+	public:
+
+		static Local<Function> callback(Handle<Value> callback, Local<Value> *promise);
+		static void complete(Handle<Function> callback, Handle<Value> error, Handle<Value> result);
+		static void defer(Handle<Function> callback, Handle<Value> error, Handle<Value> result);
+		static Local<Value> error(const char *message);
+
+	private:
+
+		static Handle<Value> Capture(const Arguments& args);
+		static Handle<Value> Settle(const Arguments& args);
+
+};
+
+#endif
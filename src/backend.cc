@@ -0,0 +1,69 @@
+/**
+ * hiddev transport
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <unistd.h>
+
+#include "backend.h"
+#include "io.h"
+
+HiddevBackend::HiddevBackend(int handle) {
+
+	this->handle = handle;
+
+	// probe the known reports once, so reads take one ioctl less
+	reportLength(IO::DATA_REPORT);
+	reportLength(IO::SETTINGS_REPORT);
+};
+
+HiddevBackend::~HiddevBackend() {
+
+	if (handle >= 0)
+		close(handle);
+};
+
+/**
+ * Returns the cached length of a report, probes it on first use
+ * @param int reportId
+ * @return int reportLength or one of the IO::ERROR_* codes
+ */
+int HiddevBackend::reportLength(int reportId) {
+
+	std::map<int, int>::iterator it = reportLengths.find(reportId);
+
+	if (it != reportLengths.end())
+		return it->second;
+
+	int length = IO::getReportLength(handle, reportId);
+
+	// errors aren't cached, the next call probes again
+	if (length >= 0)
+		reportLengths[reportId] = length;
+
+	return length;
+};
+
+int HiddevBackend::getFeatureReport(int reportId, unsigned char *buffer, size_t length) {
+
+	int ret = reportLength(reportId);
+
+	return ret < 0 ? ret : IO::getFeatureReport(handle, reportId, ret, buffer, length);
+};
+
+int HiddevBackend::setFeatureReport(int reportId, const unsigned char *buffer, size_t length) {
+
+	int ret = reportLength(reportId);
+
+	return ret < 0 ? ret : IO::setFeatureReport(handle, reportId, ret, buffer, length);
+};
+
+int HiddevBackend::getDevicePath(char *devicePath, size_t length) {
+	return IO::getDevicePath(handle, devicePath, length);
+};
+
+int HiddevBackend::getHandle() {
+	return handle;
+};
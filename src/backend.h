@@ -0,0 +1,70 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stddef.h>
+#include <map>
+
+/**
+ * Transport for feature reports
+ *
+ * Return values follow IO::getFeatureReport / IO::setFeatureReport. Calls
+ * are serialized by the owning Device.
+ */
+class Backend {
+
+	public:
+
+		virtual ~Backend() {};
+
+		virtual int getFeatureReport(int reportId, unsigned char *buffer, size_t length) = 0;
+		virtual int setFeatureReport(int reportId, const unsigned char *buffer, size_t length) = 0;
+		virtual int getDevicePath(char *devicePath, size_t length) = 0;
+
+		// file descriptor of the device, -1 if there is none
+		virtual int getHandle() { return -1; };
+
+		// waits until the next transfer is due, called by Device before it
+		// locks, so a rate limited backend doesn't stall other callers
+		virtual void pace() {};
+
+		// the settings report changed without a write since the last call,
+		// e.g. a replay reached records made with other settings
+		virtual bool settingsChanged() { return false; };
+
+};
+
+/**
+ * The hiddev ioctl interface
+ *
+ * Report lengths are probed once per open, a reopened device gets a new
+ * backend and probes again.
+ */
+class HiddevBackend: public Backend {
+
+	public:
+
+		HiddevBackend(int handle);
+		~HiddevBackend();
+
+		int getFeatureReport(int reportId, unsigned char *buffer, size_t length);
+		int setFeatureReport(int reportId, const unsigned char *buffer, size_t length);
+		int getDevicePath(char *devicePath, size_t length);
+		int getHandle();
+
+	private:
+
+		int reportLength(int reportId);
+
+		int handle;
+
+		// HIDIOCGFIELDINFO results by report id, fixed while the device is open
+		std::map<int, int> reportLengths;
+
+};
+
+#endif
@@ -0,0 +1,459 @@
+/**
+ * Unix socket broker
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <v8.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "broker.h"
+#include "aquastreamxt.h"
+#include "sampler.h"
+
+using namespace v8;
+
+Broker::Broker(Aquastream *aquastream, const char *path) {
+
+	this->aquastream = aquastream;
+	this->path = path;
+	this->bound = false;
+	this->listening = true;
+	this->closing = false;
+
+	for (int i = 0; i < 2; i++) {
+		reads[i].request.data = &reads[i];
+		reads[i].broker = this;
+		reads[i].reportId = i == 0 ? IO::DATA_REPORT : IO::SETTINGS_REPORT;
+		reads[i].active = false;
+		reads[i].error = 0;
+	}
+
+	uv_pipe_init(uv_default_loop(), &server, 0);
+	server.data = this;
+};
+
+/**
+ * Checks whether a broker accepts connections on a socket file
+ * @param const char *path
+ * @return bool
+ */
+static bool alive(const char *path) {
+
+	struct sockaddr_un address;
+
+	if (strlen(path) >= sizeof(address.sun_path))
+		return false;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	int handle = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (handle < 0)
+		return false;
+
+	bool connected = connect(handle, (struct sockaddr*) &address, sizeof(address)) == 0;
+	close(handle);
+
+	return connected;
+};
+
+/**
+ * Returns the socket path used when none is given, in $XDG_RUNTIME_DIR or
+ * else in /tmp/aquastreamxt-<uid>, which is created with mode 0700
+ *
+ * Fails if the directory isn't ours or others may write to it, so nobody
+ * else can put a socket there for a broker or a client to use.
+ *
+ * @param std::string *path
+ * @param std::string *error
+ * @return bool
+ */
+bool Broker::defaultPath(std::string *path, std::string *error) {
+
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+	std::string directory;
+
+	if (runtime && *runtime) {
+		directory = runtime;
+	} else {
+		char name[64];
+		snprintf(name, sizeof(name), "/tmp/aquastreamxt-%u", (unsigned int) geteuid());
+		directory = name;
+
+		if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+			*error = "Couldn't create " + directory + ": " + strerror(errno);
+			return false;
+		}
+	}
+
+	struct stat info;
+
+	if (lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) ||
+		info.st_uid != geteuid() || (info.st_mode & (S_IWGRP | S_IWOTH))) {
+		*error = directory + " isn't a private directory";
+		return false;
+	}
+
+	*path = directory + "/aquastreamxt.sock";
+	return true;
+};
+
+/**
+ * Starts listening on a Unix socket, a socket file left behind by a
+ * broker of the same user that is gone is replaced. The socket is only
+ * accessible by its owner.
+ *
+ * @param Aquastream *aquastream
+ * @param const char *path
+ * @param std::string *error Set on failure
+ * @return Broker* NULL on failure
+ */
+Broker *Broker::open(Aquastream *aquastream, const char *path, std::string *error) {
+
+	struct stat info;
+
+	if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+
+		if (alive(path)) {
+			*error = "A broker is already listening on ";
+			*error += path;
+			return NULL;
+		}
+
+		if (info.st_uid != geteuid()) {
+			*error = "The socket ";
+			*error += path;
+			*error += " belongs to another user";
+			return NULL;
+		}
+
+		unlink(path);
+	}
+
+	Broker *broker = new Broker(aquastream, path);
+
+	aquastream->Ref();
+
+	if (uv_pipe_bind(&broker->server, path) == 0)
+		broker->bound = true;
+
+	if (broker->bound && chmod(path, 0600) != 0) {
+
+		*error = "Couldn't restrict access to ";
+		*error += path;
+		*error += ": ";
+		*error += strerror(errno);
+
+		broker->stop();
+
+		return NULL;
+	}
+
+	if (!broker->bound || uv_listen((uv_stream_t*) &broker->server, 128, connected) != 0) {
+
+		*error = "Couldn't listen on ";
+		*error += path;
+		*error += ": ";
+		*error += uv_strerror(uv_last_error(uv_default_loop()));
+
+		broker->stop();
+
+		return NULL;
+	}
+
+	return broker;
+};
+
+const char *Broker::errorString(int error) {
+
+	if (error == ERROR_INVALID_REQUEST)
+		return "Invalid broker request";
+
+	return IO::errorString(error);
+};
+
+/**
+ * Closes the server and all connections, frees the instance once they
+ * are closed and no read is in flight
+ */
+void Broker::stop() {
+
+	if (closing)
+		return;
+
+	closing = true;
+
+	// a new broker may bind the path right away
+	if (bound)
+		unlink(path.c_str());
+
+	for (size_t i = 0; i < connections.size(); i++)
+		disconnect(connections[i]);
+
+	uv_close((uv_handle_t*) &server, closed);
+};
+
+void Broker::closed(uv_handle_t *handle) {
+
+	Broker *broker = static_cast<Broker*>(handle->data);
+
+	broker->listening = false;
+	broker->release();
+};
+
+void Broker::release() {
+
+	if (listening || !connections.empty() || reads[0].active || reads[1].active)
+		return;
+
+	aquastream->Unref();
+	delete this;
+};
+
+void Broker::connected(uv_stream_t *server, int status) {
+
+	Broker *broker = static_cast<Broker*>(server->data);
+
+	if (status != 0 || broker->closing)
+		return;
+
+	Connection *connection = new Connection();
+	connection->broker = broker;
+	connection->buffered = 0;
+
+	uv_pipe_init(uv_default_loop(), &connection->pipe, 0);
+	connection->pipe.data = connection;
+
+	broker->connections.push_back(connection);
+
+	if (uv_accept(server, (uv_stream_t*) &connection->pipe) != 0 ||
+		uv_read_start((uv_stream_t*) &connection->pipe, allocate, received) != 0)
+		broker->disconnect(connection);
+};
+
+uv_buf_t Broker::allocate(uv_handle_t *handle, size_t size) {
+
+	Connection *connection = static_cast<Connection*>(handle->data);
+
+	return uv_buf_init(
+		(char*) connection->input + connection->buffered,
+		sizeof(connection->input) - connection->buffered
+	);
+};
+
+/**
+ * Handles the complete request frames, a partial one is kept for the
+ * next read
+ */
+void Broker::received(uv_stream_t *stream, ssize_t length, uv_buf_t buffer) {
+
+	Connection *connection = static_cast<Connection*>(stream->data);
+	Broker *broker = connection->broker;
+
+	// end of stream or error
+	if (length < 0) {
+		broker->disconnect(connection);
+		return;
+	}
+
+	connection->buffered += length;
+
+	size_t offset = 0;
+
+	while (connection->buffered - offset >= sizeof(BrokerRequest)) {
+
+		BrokerRequest frame;
+		memcpy(&frame, connection->input + offset, sizeof(frame));
+		offset += sizeof(frame);
+
+		broker->request(connection, &frame);
+
+		// dropped while handling the request
+		if (uv_is_closing((uv_handle_t*) &connection->pipe))
+			return;
+	}
+
+	connection->buffered -= offset;
+	memmove(connection->input, connection->input + offset, connection->buffered);
+};
+
+/**
+ * Queues a client for the read of a report, starts the read unless one
+ * is in flight
+ */
+void Broker::request(Connection *connection, const BrokerRequest *frame) {
+
+	if (frame->op != OP_GET_REPORT || (frame->reportId != IO::DATA_REPORT && frame->reportId != IO::SETTINGS_REPORT)) {
+		respond(connection, frame, NULL, ERROR_INVALID_REQUEST);
+		return;
+	}
+
+	Read *read = &reads[frame->reportId == IO::DATA_REPORT ? 0 : 1];
+
+	Waiter waiter;
+	waiter.connection = connection;
+	waiter.tag = frame->tag;
+
+	read->waiters.push_back(waiter);
+
+	if (read->active)
+		return;
+
+	read->active = true;
+
+	uv_queue_work(uv_default_loop(), &read->request, ReadWork, ReadAfter);
+};
+
+void Broker::ReadWork(uv_work_t *request) {
+
+	Read *read = static_cast<Read*>(request->data);
+	Device *device = read->broker->aquastream->device;
+
+	if (read->reportId == IO::DATA_REPORT) {
+		read->error = device->readData(&read->data, &read->settings);
+	} else {
+		read->error = device->readSettings(&read->settings, false);
+	}
+
+	read->timestamp = Sampler::now();
+};
+
+/**
+ * Sends the report to everyone who asked for it during the read
+ */
+void Broker::ReadAfter(uv_work_t *request, int status) {
+
+	Read *read = static_cast<Read*>(request->data);
+	Broker *broker = read->broker;
+
+	read->active = false;
+
+	if (broker->closing) {
+		broker->release();
+		return;
+	}
+
+	if (read->error >= 0 && read->reportId == IO::DATA_REPORT) {
+		HandleScope scope;
+		broker->aquastream->sampled(read->timestamp, &read->data);
+	}
+
+	std::vector<Waiter> waiters;
+	waiters.swap(read->waiters);
+
+	for (size_t i = 0; i < waiters.size(); i++) {
+
+		BrokerRequest frame;
+		frame.op = OP_GET_REPORT;
+		frame.reportId = read->reportId;
+		frame.tag = waiters[i].tag;
+
+		broker->respond(waiters[i].connection, &frame, read, read->error);
+	}
+};
+
+/**
+ * Writes a response frame, drops clients that don't keep up with reading
+ * @param Connection *connection
+ * @param const BrokerRequest *frame The request answered
+ * @param const Read *read NULL without reports
+ * @param int status 0 or an error
+ */
+void Broker::respond(Connection *connection, const BrokerRequest *frame, const Read *read, int status) {
+
+	if (uv_is_closing((uv_handle_t*) &connection->pipe))
+		return;
+
+	if (connection->pipe.write_queue_size > MAX_WRITE_QUEUE) {
+		disconnect(connection);
+		return;
+	}
+
+	Write *write = new Write();
+	write->request.data = write;
+
+	BrokerResponse response;
+	response.op = frame->op;
+	response.reportId = frame->reportId;
+	response.tag = frame->tag;
+	response.status = status < 0 ? status : 0;
+	response.length = 0;
+
+	unsigned char *payload = write->frame + sizeof(response);
+
+	if (read && status >= 0) {
+
+		// data reports come with the settings they need to be decoded
+		if (read->reportId == IO::DATA_REPORT) {
+			memcpy(payload, &read->data, sizeof(read->data));
+			response.length += sizeof(read->data);
+		}
+
+		memcpy(payload + response.length, &read->settings, sizeof(read->settings));
+		response.length += sizeof(read->settings);
+	}
+
+	memcpy(write->frame, &response, sizeof(response));
+
+	uv_buf_t buffer = uv_buf_init((char*) write->frame, sizeof(response) + response.length);
+
+	if (uv_write(&write->request, (uv_stream_t*) &connection->pipe, &buffer, 1, written) != 0) {
+		delete write;
+		disconnect(connection);
+	}
+};
+
+void Broker::written(uv_write_t *request, int status) {
+	delete static_cast<Write*>(request->data);
+};
+
+/**
+ * Closes a connection and forgets its waiting requests
+ */
+void Broker::disconnect(Connection *connection) {
+
+	if (uv_is_closing((uv_handle_t*) &connection->pipe))
+		return;
+
+	for (int i = 0; i < 2; i++) {
+
+		std::vector<Waiter> *waiters = &reads[i].waiters;
+
+		for (size_t j = waiters->size(); j-- > 0;) {
+			if ((*waiters)[j].connection == connection)
+				waiters->erase(waiters->begin() + j);
+		}
+	}
+
+	uv_close((uv_handle_t*) &connection->pipe, disconnected);
+};
+
+void Broker::disconnected(uv_handle_t *handle) {
+
+	Connection *connection = static_cast<Connection*>(handle->data);
+	Broker *broker = connection->broker;
+
+	for (size_t i = 0; i < broker->connections.size(); i++) {
+		if (broker->connections[i] == connection) {
+			broker->connections.erase(broker->connections.begin() + i);
+			break;
+		}
+	}
+
+	delete connection;
+
+	if (broker->closing)
+		broker->release();
+};
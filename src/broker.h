@@ -0,0 +1,130 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <node.h>
+#include <uv.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "io.h"
+
+class Aquastream;
+
+/**
+ * Request frame, see doc/broker-protocol.md
+ */
+struct BrokerRequest {
+	uint8_t op;
+	uint8_t reportId;
+	uint16_t tag;
+} __attribute__((__packed__));
+
+/**
+ * Response frame header, followed by length bytes of raw reports
+ */
+struct BrokerResponse {
+	uint8_t op;
+	uint8_t reportId;
+	uint16_t tag;
+	int16_t status;
+	uint16_t length;
+} __attribute__((__packed__));
+
+/**
+ * Serves the reports of one device to many clients over a Unix socket
+ *
+ * Everything but the device reads runs on the event loop. Requests for a
+ * report that arrive while it is being read wait for that read, so any
+ * number of clients cost one USB transaction per report at a time.
+ */
+class Broker {
+
+	public:
+
+		static const int OP_GET_REPORT = 1;
+
+		// status of a request the broker doesn't understand
+		static const int ERROR_INVALID_REQUEST = -64;
+
+		// a client with this many bytes of unsent responses is dropped
+		static const size_t MAX_WRITE_QUEUE = 65536;
+
+		static Broker *open(Aquastream *aquastream, const char *path, std::string *error);
+		static bool defaultPath(std::string *path, std::string *error);
+		static const char *errorString(int error);
+
+		void stop();
+
+	private:
+
+		struct Connection {
+			uv_pipe_t pipe;
+			Broker *broker;
+
+			// received bytes, a partial frame is kept at the start
+			unsigned char input[4096];
+			size_t buffered;
+		};
+
+		struct Waiter {
+			Connection *connection;
+			uint16_t tag;
+		};
+
+		// the read of one report id and everyone waiting for it
+		struct Read {
+			uv_work_t request;
+			Broker *broker;
+			int reportId;
+			bool active;
+			std::vector<Waiter> waiters;
+			int error;
+			uint64_t timestamp;
+			IO::pumpDataReport data;
+			IO::pumpSettingsReport settings;
+		};
+
+		struct Write {
+			uv_write_t request;
+			unsigned char frame[sizeof(BrokerResponse) + sizeof(IO::pumpDataReport) + sizeof(IO::pumpSettingsReport)];
+		};
+
+		Broker(Aquastream *aquastream, const char *path);
+
+		static void connected(uv_stream_t *server, int status);
+		static uv_buf_t allocate(uv_handle_t *handle, size_t size);
+		static void received(uv_stream_t *stream, ssize_t length, uv_buf_t buffer);
+		static void written(uv_write_t *request, int status);
+		static void disconnected(uv_handle_t *handle);
+		static void closed(uv_handle_t *handle);
+		static void ReadWork(uv_work_t *request);
+		static void ReadAfter(uv_work_t *request, int status);
+
+		void request(Connection *connection, const BrokerRequest *frame);
+		void respond(Connection *connection, const BrokerRequest *frame, const Read *read, int status);
+		void disconnect(Connection *connection);
+		void release();
+
+		Aquastream *aquastream;
+		std::string path;
+
+		uv_pipe_t server;
+		std::vector<Connection*> connections;
+
+		// data and settings report
+		Read reads[2];
+
+		// the socket file is ours, the server handle isn't closed yet
+		bool bound;
+		bool listening;
+		bool closing;
+
+};
+
+#endif
@@ -0,0 +1,342 @@
+/**
+ * Broker client
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <v8.h>
+#include <string.h>
+
+#include "client.h"
+#include "async.h"
+#include "io.h"
+#include "projection.h"
+
+using namespace v8;
+
+AquastreamClient::AquastreamClient() {
+
+	tag = 0;
+	buffered = 0;
+
+	uv_pipe_init(uv_default_loop(), &pipe, 0);
+	pipe.data = this;
+	connect.data = this;
+};
+
+void AquastreamClient::Init(Handle<Object> target) {
+
+	// Prepare constructor template
+	Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+	tpl->SetClassName(String::NewSymbol("AquastreamClient"));
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+	// Prototype
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("getReport"),
+		FunctionTemplate::New(GetReport)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("close"),
+		FunctionTemplate::New(Close)->GetFunction()
+	);
+
+	Persistent<Function> constructor = Persistent<Function>::New(tpl->GetFunction());
+	target->Set(String::NewSymbol("AquastreamClient"), constructor);
+};
+
+/**
+ * new AquastreamClient([path])
+ *
+ * Connects to the broker listening on path, default Broker::defaultPath().
+ * Requests made while connecting are sent once connected.
+ */
+Handle<Value> AquastreamClient::New(const Arguments& args) {
+
+	HandleScope scope;
+
+	std::string path, error;
+
+	if (args[0]->IsString()) {
+		path = *String::Utf8Value(args[0]);
+	} else if (!Broker::defaultPath(&path, &error)) {
+		ThrowException(Exception::Error(String::New(error.c_str())));
+		return scope.Close(Undefined());
+	}
+
+	AquastreamClient *client = new AquastreamClient();
+	client->Wrap(args.This());
+
+	// kept alive until the connection is closed
+	client->Ref();
+
+	uv_pipe_connect(&client->connect, &client->pipe, path.c_str(), connected);
+
+	return args.This();
+};
+
+void AquastreamClient::connected(uv_connect_t *request, int status) {
+
+	AquastreamClient *client = static_cast<AquastreamClient*>(request->data);
+
+	if (!client->error.empty())
+		return;
+
+	if (status != 0 || uv_read_start((uv_stream_t*) &client->pipe, allocate, received) != 0) {
+
+		std::string message = "Couldn't connect to the broker: ";
+		message += uv_strerror(uv_last_error(uv_default_loop()));
+
+		client->fail(message.c_str());
+	}
+};
+
+/**
+ * getReport(reportId, [options], [callback])
+ *
+ * Like Aquastream.getReport, the broker reads the report or hands out the
+ * one it is reading anyway. Returns a Promise if no callback is given.
+ */
+Handle<Value> AquastreamClient::GetReport(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (args.Length() < 1) {
+		ThrowException(Exception::TypeError(String::New("Wrong number of arguments")));
+		return scope.Close(Undefined());
+	}
+
+	int reportId = args[0]->NumberValue();
+
+	if (!args[0]->IsNumber() || (reportId != IO::DATA_REPORT && reportId != IO::SETTINGS_REPORT)) {
+		ThrowException(Exception::TypeError(String::New("Invalid Feature Report ID")));
+		return scope.Close(Undefined());
+	}
+
+	AquastreamClient *client = ObjectWrap::Unwrap<AquastreamClient>(args.This());
+	Projection *projection = NULL;
+	int callbackIndex = 1;
+
+	if (args[1]->IsObject() && !args[1]->IsFunction()) {
+
+		Local<Value> fields = args[1]->ToObject()->Get(String::NewSymbol("fields"));
+		callbackIndex = 2;
+
+		if (fields->IsArray()) {
+
+			if (reportId != IO::DATA_REPORT) {
+				ThrowException(Exception::TypeError(String::New("Fields can only be selected from the data report")));
+				return scope.Close(Undefined());
+			}
+
+			projection = Projection::get(Local<Array>::Cast(fields));
+
+			if (!projection)
+				return scope.Close(Undefined());
+
+		} else if (!fields->IsUndefined()) {
+			ThrowException(Exception::TypeError(String::New("Invalid fields")));
+			return scope.Close(Undefined());
+		}
+	}
+
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(args[callbackIndex], &returnValue);
+	const char *error = NULL;
+
+	if (cb.IsEmpty()) {
+		if (projection)
+			projection->release();
+		return scope.Close(Undefined());
+	}
+
+	if (!client->error.empty())
+		error = client->error.c_str();
+	else if (client->requests.size() > 0xffff)
+		error = "Too many pending requests";
+
+	if (error) {
+		if (projection)
+			projection->release();
+		Async::defer(cb, Async::error(error), Undefined());
+		return scope.Close(returnValue);
+	}
+
+	while (client->requests.count(client->tag))
+		client->tag++;
+
+	Write *write = new Write();
+	write->request.data = write;
+	write->frame.op = Broker::OP_GET_REPORT;
+	write->frame.reportId = reportId;
+	write->frame.tag = client->tag++;
+
+	uv_buf_t buffer = uv_buf_init((char*) &write->frame, sizeof(write->frame));
+
+	if (uv_write(&write->request, (uv_stream_t*) &client->pipe, &buffer, 1, written) != 0) {
+		delete write;
+		if (projection)
+			projection->release();
+		Async::defer(cb, Async::error("Couldn't send the request"), Undefined());
+		return scope.Close(returnValue);
+	}
+
+	Request *request = &client->requests[write->frame.tag];
+	request->callback = Persistent<Function>::New(cb);
+	request->projection = projection;
+
+	return scope.Close(returnValue);
+};
+
+/**
+ * close()
+ *
+ * Closes the connection, pending requests fail
+ */
+Handle<Value> AquastreamClient::Close(const Arguments& args) {
+
+	HandleScope scope;
+
+	AquastreamClient *client = ObjectWrap::Unwrap<AquastreamClient>(args.This());
+
+	client->fail("Client closed");
+
+	return scope.Close(Undefined());
+};
+
+void AquastreamClient::written(uv_write_t *request, int status) {
+	delete static_cast<Write*>(request->data);
+};
+
+uv_buf_t AquastreamClient::allocate(uv_handle_t *handle, size_t size) {
+
+	AquastreamClient *client = static_cast<AquastreamClient*>(handle->data);
+
+	return uv_buf_init((char*) client->input + client->buffered, sizeof(client->input) - client->buffered);
+};
+
+/**
+ * Handles the complete response frames, a partial one is kept for the
+ * next read
+ */
+void AquastreamClient::received(uv_stream_t *stream, ssize_t length, uv_buf_t buffer) {
+
+	HandleScope scope;
+
+	AquastreamClient *client = static_cast<AquastreamClient*>(stream->data);
+
+	if (length < 0) {
+		client->fail("Broker closed the connection");
+		return;
+	}
+
+	client->buffered += length;
+
+	size_t offset = 0;
+
+	while (client->buffered - offset >= sizeof(BrokerResponse)) {
+
+		BrokerResponse response;
+		memcpy(&response, client->input + offset, sizeof(response));
+
+		if (sizeof(response) + response.length > sizeof(client->input)) {
+			client->fail("Invalid broker response");
+			return;
+		}
+
+		if (client->buffered - offset < sizeof(response) + response.length)
+			break;
+
+		client->respond(&response, client->input + offset + sizeof(response));
+		offset += sizeof(response) + response.length;
+
+		// closed by a callback
+		if (!client->error.empty())
+			return;
+	}
+
+	client->buffered -= offset;
+	memmove(client->input, client->input + offset, client->buffered);
+};
+
+/**
+ * Decodes a response and completes its request
+ */
+void AquastreamClient::respond(const BrokerResponse *response, const unsigned char *payload) {
+
+	std::map<uint16_t, Request>::iterator it = requests.find(response->tag);
+
+	if (it == requests.end())
+		return;
+
+	Local<Function> callback = Local<Function>::New(it->second.callback);
+	Projection *projection = it->second.projection;
+
+	it->second.callback.Dispose();
+	requests.erase(it);
+
+	IO::pumpDataReport data;
+	IO::pumpSettingsReport settings;
+
+	if (response->status < 0) {
+		Async::complete(callback, Async::error(Broker::errorString(response->status)), Undefined());
+	} else if (response->reportId == IO::DATA_REPORT && response->length == sizeof(data) + sizeof(settings)) {
+		memcpy(&data, payload, sizeof(data));
+		memcpy(&settings, payload + sizeof(data), sizeof(settings));
+
+		Async::complete(callback, Null(), projection
+			? projection->project(&data, &settings)
+			: IO::getData(&data, &settings)
+		);
+	} else if (response->reportId == IO::SETTINGS_REPORT && response->length == sizeof(settings)) {
+		memcpy(&settings, payload, sizeof(settings));
+
+		Async::complete(callback, Null(), IO::getSettings(&settings));
+	} else {
+		Async::complete(callback, Async::error("Invalid broker response"), Undefined());
+	}
+
+	if (projection)
+		projection->release();
+};
+
+/**
+ * Closes the connection and fails every pending request
+ */
+void AquastreamClient::fail(const char *message) {
+
+	if (!error.empty())
+		return;
+
+	HandleScope scope;
+
+	error = message;
+
+	uv_close((uv_handle_t*) &pipe, closed);
+
+	std::map<uint16_t, Request> pending;
+	pending.swap(requests);
+
+	std::map<uint16_t, Request>::iterator it;
+
+	for (it = pending.begin(); it != pending.end(); it++) {
+		Local<Function> callback = Local<Function>::New(it->second.callback);
+		it->second.callback.Dispose();
+
+		if (it->second.projection)
+			it->second.projection->release();
+
+		// close() fails them too, callbacks never run inside the call
+		Async::defer(callback, Async::error(message), Undefined());
+	}
+};
+
+void AquastreamClient::closed(uv_handle_t *handle) {
+
+	AquastreamClient *client = static_cast<AquastreamClient*>(handle->data);
+
+	client->Unref();
+};
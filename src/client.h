@@ -0,0 +1,70 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <node.h>
+#include <uv.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#include "broker.h"
+
+class Projection;
+
+/**
+ * Reads the reports of a pump through the broker of another process
+ */
+class AquastreamClient: public node::ObjectWrap {
+
+	public:
+		static void Init(v8::Handle<v8::Object> target);
+
+	private:
+		AquastreamClient();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetReport(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Close(const v8::Arguments& args);
+
+	static void connected(uv_connect_t *request, int status);
+	static uv_buf_t allocate(uv_handle_t *handle, size_t size);
+	static void received(uv_stream_t *stream, ssize_t length, uv_buf_t buffer);
+	static void written(uv_write_t *request, int status);
+	static void closed(uv_handle_t *handle);
+
+	void respond(const BrokerResponse *response, const unsigned char *payload);
+	void fail(const char *message);
+
+	// a getReport() waiting for its response
+	struct Request {
+		v8::Persistent<v8::Function> callback;
+		Projection *projection;
+	};
+
+	struct Write {
+		uv_write_t request;
+		BrokerRequest frame;
+	};
+
+	uv_pipe_t pipe;
+	uv_connect_t connect;
+
+	// pending requests by tag, the next tag to use
+	std::map<uint16_t, Request> requests;
+	uint16_t tag;
+
+	// received bytes, a partial frame is kept at the start
+	unsigned char input[4096];
+	size_t buffered;
+
+	// set once the connection failed or was closed
+	std::string error;
+
+};
+
+#endif
@@ -5,6 +5,8 @@
  * @author Alexander Dick <alex@dick.at>
  */
 
+#include <string.h>
+
 #include "convert.h"
 
 double Convert::temperature(u_int16_t temperature) {
@@ -171,4 +173,301 @@ double Convert::controllerOutScale(int32_t value) {
 	res = value / res;
 	return (res);
 
-};
\ No newline at end of file
+};
+
+/*
+ * Batch conversions
+ *
+ * Every conversion above that is used on columns of samples is either
+ * raw / divisor or numerator / (raw / cal) with a cutoff. The kernels below
+ * do exactly these double operations, so the results match the scalar
+ * functions bit for bit; only the loop is vectorized. The AVX2 kernels are
+ * compiled for that target and picked at runtime.
+ */
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// set by Convert::useKernel()
+static int kernelLimit = Convert::KERNEL_AVX2;
+
+static inline double scalarDivide(double raw, double divisor) {
+	return raw / divisor;
+}
+
+static inline double scalarReciprocal(double raw, double numerator, double cal, double cutoff, bool truncate) {
+
+	double res = numerator / (raw / cal);
+
+	if (raw >= cutoff)
+		res = 0;
+
+	return truncate ? (int) res : res;
+}
+
+#ifdef CONVERT_AVX2
+
+static bool hasAvx2() {
+
+	static int avx2 = -1;
+
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+
+	return avx2;
+}
+
+__attribute__((target("avx2"))) static inline __m256d load4(const u_int16_t *raw) {
+
+	u_int64_t packed;
+	memcpy(&packed, raw, sizeof(packed));
+
+	return _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(_mm_cvtsi64_si128(packed)));
+}
+
+__attribute__((target("avx2"))) static inline __m256d load4(const u_int32_t *raw) {
+
+	// there is no unsigned conversion, values >= 2^31 come out negative
+	__m256d value = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) raw));
+	__m256d negative = _mm256_cmp_pd(value, _mm256_setzero_pd(), _CMP_LT_OQ);
+
+	return _mm256_add_pd(value, _mm256_and_pd(negative, _mm256_set1_pd(4294967296.0)));
+}
+
+__attribute__((target("avx2"))) static inline void store4(double *out, __m256d value) {
+	_mm256_storeu_pd(out, value);
+}
+
+__attribute__((target("avx2"))) static inline void store4(float *out, __m256d value) {
+	_mm_storeu_ps(out, _mm256_cvtpd_ps(value));
+}
+
+template <typename Raw, typename Out>
+__attribute__((target("avx2"))) static size_t divideAvx2(const Raw *raw, double divisor, Out *out, size_t count) {
+
+	__m256d d = _mm256_set1_pd(divisor);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		store4(out + i, _mm256_div_pd(load4(raw + i), d));
+
+	return i;
+}
+
+template <typename Raw, typename Out>
+__attribute__((target("avx2"))) static size_t reciprocalAvx2(
+	const Raw *raw,
+	double numerator,
+	double cal,
+	double cutoff,
+	bool truncate,
+	Out *out,
+	size_t count
+) {
+
+	__m256d n = _mm256_set1_pd(numerator);
+	__m256d c = _mm256_set1_pd(cal);
+	__m256d limit = _mm256_set1_pd(cutoff);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+
+		__m256d value = load4(raw + i);
+		__m256d res = _mm256_div_pd(n, _mm256_div_pd(value, c));
+
+		res = _mm256_andnot_pd(_mm256_cmp_pd(value, limit, _CMP_GE_OQ), res);
+
+		// cvttpd2dq truncates like the (int) cast, including its overflow value
+		if (truncate)
+			res = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(res));
+
+		store4(out + i, res);
+	}
+
+	return i;
+}
+
+#endif
+
+#ifdef __SSE2__
+
+static inline __m128d load2(const u_int16_t *raw) {
+
+	u_int32_t packed;
+	memcpy(&packed, raw, sizeof(packed));
+
+	return _mm_cvtepi32_pd(_mm_unpacklo_epi16(_mm_cvtsi32_si128(packed), _mm_setzero_si128()));
+}
+
+static inline __m128d load2(const u_int32_t *raw) {
+
+	__m128d value = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*) raw));
+	__m128d negative = _mm_cmplt_pd(value, _mm_setzero_pd());
+
+	return _mm_add_pd(value, _mm_and_pd(negative, _mm_set1_pd(4294967296.0)));
+}
+
+static inline void store2(double *out, __m128d value) {
+	_mm_storeu_pd(out, value);
+}
+
+static inline void store2(float *out, __m128d value) {
+	_mm_storel_pi((__m64*) out, _mm_cvtpd_ps(value));
+}
+
+template <typename Raw, typename Out>
+static size_t divideSse2(const Raw *raw, double divisor, Out *out, size_t count) {
+
+	__m128d d = _mm_set1_pd(divisor);
+	size_t i = 0;
+
+	for (; i + 2 <= count; i += 2)
+		store2(out + i, _mm_div_pd(load2(raw + i), d));
+
+	return i;
+}
+
+template <typename Raw, typename Out>
+static size_t reciprocalSse2(
+	const Raw *raw,
+	double numerator,
+	double cal,
+	double cutoff,
+	bool truncate,
+	Out *out,
+	size_t count
+) {
+
+	__m128d n = _mm_set1_pd(numerator);
+	__m128d c = _mm_set1_pd(cal);
+	__m128d limit = _mm_set1_pd(cutoff);
+	size_t i = 0;
+
+	for (; i + 2 <= count; i += 2) {
+
+		__m128d value = load2(raw + i);
+		__m128d res = _mm_div_pd(n, _mm_div_pd(value, c));
+
+		res = _mm_andnot_pd(_mm_cmpge_pd(value, limit), res);
+
+		if (truncate)
+			res = _mm_cvtepi32_pd(_mm_cvttpd_epi32(res));
+
+		store2(out + i, res);
+	}
+
+	return i;
+}
+
+#endif
+
+/**
+ * out[i] = raw[i] / divisor
+ */
+template <typename Raw, typename Out>
+static void divide(const Raw *raw, double divisor, Out *out, size_t count) {
+
+	size_t i = 0;
+
+#if defined(CONVERT_AVX2)
+	if (kernelLimit >= Convert::KERNEL_AVX2 && hasAvx2())
+		i = divideAvx2(raw, divisor, out, count);
+#endif
+#if defined(__SSE2__)
+	if (kernelLimit >= Convert::KERNEL_SSE2)
+		i += divideSse2(raw + i, divisor, out + i, count - i);
+#endif
+
+	for (; i < count; i++)
+		out[i] = scalarDivide(raw[i], divisor);
+}
+
+/**
+ * out[i] = numerator / (raw[i] / cal), 0 if raw[i] >= cutoff
+ */
+template <typename Raw, typename Out>
+static void reciprocal(const Raw *raw, double numerator, double cal, double cutoff, bool truncate, Out *out, size_t count) {
+
+	size_t i = 0;
+
+#if defined(CONVERT_AVX2)
+	if (kernelLimit >= Convert::KERNEL_AVX2 && hasAvx2())
+		i = reciprocalAvx2(raw, numerator, cal, cutoff, truncate, out, count);
+#endif
+#if defined(__SSE2__)
+	if (kernelLimit >= Convert::KERNEL_SSE2)
+		i += reciprocalSse2(raw + i, numerator, cal, cutoff, truncate, out + i, count - i);
+#endif
+
+	for (; i < count; i++)
+		out[i] = scalarReciprocal(raw[i], numerator, cal, cutoff, truncate);
+}
+
+/**
+ * Limits the batch conversions to a kernel and the narrower ones, so the
+ * benchmark can check each against the scalar functions. Not thread safe,
+ * call it before converting.
+ * @param int kernel One of the KERNEL_* constants
+ * @return int The widest kernel that is used now, lower if the CPU or
+ * the build doesn't have the one asked for
+ */
+int Convert::useKernel(int kernel) {
+
+	int available = KERNEL_SCALAR;
+
+#if defined(__SSE2__)
+	available = KERNEL_SSE2;
+#endif
+#if defined(CONVERT_AVX2)
+	if (hasAvx2())
+		available = KERNEL_AVX2;
+#endif
+
+	kernelLimit = kernel < available ? kernel : available;
+
+	return kernelLimit;
+};
+
+void Convert::temperature(const u_int16_t *raw, double *out, size_t count) {
+	divide(raw, SCALE_TEMPERATURE, out, count);
+};
+
+void Convert::temperature(const u_int16_t *raw, float *out, size_t count) {
+	divide(raw, SCALE_TEMPERATURE, out, count);
+};
+
+void Convert::flow(const u_int32_t *raw, int measureEdges, int calImpulse, double *out, size_t count) {
+	reciprocal(raw, (double) TIMER_RPM * 3600, ((double) measureEdges / 2) / calImpulse, MIN_FLOW, false, out, count);
+};
+
+void Convert::flow(const u_int32_t *raw, int measureEdges, int calImpulse, float *out, size_t count) {
+	reciprocal(raw, (double) TIMER_RPM * 3600, ((double) measureEdges / 2) / calImpulse, MIN_FLOW, false, out, count);
+};
+
+void Convert::fanRpm(const u_int16_t *raw, int measureEdges, double *out, size_t count) {
+	reciprocal(raw, (double) TIMER_RPM * 60, (double) measureEdges / 4, MIN_RPM, true, out, count);
+};
+
+void Convert::fanRpm(const u_int32_t *raw, int measureEdges, double *out, size_t count) {
+	reciprocal(raw, (double) TIMER_RPM * 60, (double) measureEdges / 4, MIN_RPM, true, out, count);
+};
+
+void Convert::fanRpm(const u_int32_t *raw, int measureEdges, float *out, size_t count) {
+	reciprocal(raw, (double) TIMER_RPM * 60, (double) measureEdges / 4, MIN_RPM, true, out, count);
+};
+
+void Convert::voltage(const u_int16_t *raw, double *out, size_t count) {
+	divide(raw, SCALE_12V, out, count);
+};
+
+void Convert::fanVoltage(const u_int16_t *raw, double *out, size_t count) {
+	divide(raw, SCALE_FAN_OUT, out, count);
+};
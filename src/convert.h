@@ -7,6 +7,7 @@
 #define CONVERT_H
 
 #include <sys/types.h>
+#include <stddef.h>
 
 class Convert {
 
@@ -40,6 +41,31 @@ class Convert {
 
 		static double controllerOutScale(int32_t value);
 
+		/**
+		 * Batch versions, out[i] is the conversion of raw[i] with the same
+		 * result as the scalar function. Vectorized with AVX2 or SSE2 where
+		 * the CPU has them.
+		 */
+		static void temperature(const u_int16_t *raw, double *out, size_t count);
+		static void temperature(const u_int16_t *raw, float *out, size_t count);
+
+		static void flow(const u_int32_t *raw, int measureEdges, int calImpulse, double *out, size_t count);
+		static void flow(const u_int32_t *raw, int measureEdges, int calImpulse, float *out, size_t count);
+
+		static void fanRpm(const u_int16_t *raw, int measureEdges, double *out, size_t count);
+		static void fanRpm(const u_int32_t *raw, int measureEdges, double *out, size_t count);
+		static void fanRpm(const u_int32_t *raw, int measureEdges, float *out, size_t count);
+
+		static void voltage(const u_int16_t *raw, double *out, size_t count);
+		static void fanVoltage(const u_int16_t *raw, double *out, size_t count);
+
+		// batch kernels, useKernel() limits the widest one used
+		static const int KERNEL_SCALAR = 0;
+		static const int KERNEL_SSE2 = 1;
+		static const int KERNEL_AVX2 = 2;
+
+		static int useKernel(int kernel);
+
 	private:
 
 		// clock freq of the pump
@@ -0,0 +1,155 @@
+/**
+ * Per field change detection of the data report
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <v8.h>
+#include <math.h>
+#include <string.h>
+
+#include "deadband.h"
+
+using namespace v8;
+
+Deadband::Deadband() {
+	initialized = false;
+};
+
+Deadband::~Deadband() {
+
+	for (size_t i = 0; i < watches.size(); i++)
+		watches[i].key.Dispose();
+};
+
+Deadband *Deadband::compile(Handle<Object> deadbands, std::string *error) {
+
+	HandleScope scope;
+
+	size_t count;
+	const SchemaField *fields = Schema::fields(IO::DATA_REPORT, &count);
+	std::vector<double> bands(count, -1);
+
+	// alarms fire on every flip
+	for (size_t j = 0; j < count; j++) {
+		if (!strncmp(fields[j].path, "alarm.", 6))
+			bands[j] = 0;
+	}
+
+	Local<Array> paths = deadbands->GetOwnPropertyNames();
+
+	for (uint32_t i = 0; i < paths->Length(); i++) {
+
+		Local<Value> name = paths->Get(i);
+		Local<Value> value = deadbands->Get(name);
+
+		String::Utf8Value utf8(name);
+		std::string path(*utf8 ? *utf8 : "");
+		size_t length = path.length();
+		bool found = false;
+
+		if (!value->IsNumber() || !(value->NumberValue() >= 0)) {
+			*error = path;
+			return NULL;
+		}
+
+		for (size_t j = 0; j < count; j++) {
+
+			const char *candidate = fields[j].path;
+
+			if (!strncmp(candidate, path.c_str(), length) && (candidate[length] == 0 || candidate[length] == '.')) {
+				bands[j] = value->NumberValue();
+				found = true;
+			}
+		}
+
+		if (!found || length == 0) {
+			*error = path;
+			return NULL;
+		}
+	}
+
+	Deadband *deadband = new Deadband();
+
+	for (size_t j = 0; j < count; j++) {
+
+		if (bands[j] < 0)
+			continue;
+
+		Watch watch;
+		watch.field = &fields[j];
+		watch.key = Persistent<String>::New(String::NewSymbol(fields[j].path));
+		watch.deadband = bands[j];
+		watch.value = deadband->emitted.size();
+
+		deadband->watches.push_back(watch);
+		deadband->emitted.resize(watch.value + fields[j].count);
+	}
+
+	return deadband;
+};
+
+/**
+ * Compares a report with the last emitted values, the values of changed
+ * fields become the new reference. The first report changes every field.
+ *
+ * @param const IO::pumpDataReport *report
+ * @param const IO::pumpSettingsReport *settings
+ * @return uint64_t Bit i is set if watch i changed, 0 if nothing did
+ */
+uint64_t Deadband::compare(const IO::pumpDataReport *report, const IO::pumpSettingsReport *settings) {
+
+	uint64_t changed = 0;
+
+	for (size_t i = 0; i < watches.size(); i++) {
+
+		const Watch *watch = &watches[i];
+		double *values = &emitted[watch->value];
+		bool moved = !initialized;
+
+		for (size_t j = 0; j < watch->field->count && !moved; j++) {
+
+			double delta = fabs(watch->field->number((const unsigned char*) report, j, settings) - values[j]);
+
+			// a deadband of 0 fires on any change
+			moved = watch->deadband > 0 ? delta >= watch->deadband : delta > 0;
+		}
+
+		if (!moved)
+			continue;
+
+		changed |= (uint64_t) 1 << i;
+
+		for (size_t j = 0; j < watch->field->count; j++)
+			values[j] = watch->field->number((const unsigned char*) report, j, settings);
+	}
+
+	initialized = true;
+
+	return changed;
+};
+
+/**
+ * Returns the changed fields as { path: value }
+ * @param uint64_t changed As returned by compare()
+ * @param const IO::pumpDataReport *report
+ * @param const IO::pumpSettingsReport *settings
+ * @return Handle<Object>
+ */
+Handle<Object> Deadband::changes(
+	uint64_t changed,
+	const IO::pumpDataReport *report,
+	const IO::pumpSettingsReport *settings
+) const {
+
+	HandleScope scope;
+	Local<Object> object = Object::New();
+
+	for (size_t i = 0; i < watches.size(); i++) {
+		if (changed & ((uint64_t) 1 << i))
+			object->Set(watches[i].key, Schema::decodeField(watches[i].field, (const unsigned char*) report, settings));
+	}
+
+	return scope.Close(object);
+};
@@ -0,0 +1,68 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <v8.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "io.h"
+#include "schema.h"
+
+/**
+ * Change detection on the data report
+ *
+ * Remembers the values last emitted per watched field and reports a field
+ * as changed once it moved by at least its deadband. Alarm bits are always
+ * watched. compare() doesn't touch V8, so the sampling thread runs it and
+ * JS only sees reports with changes.
+ */
+class Deadband {
+
+	public:
+
+		/**
+		 * Compiles { path: deadband }, a path of an object like
+		 * "current.temperature" applies to all its fields
+		 * @param Handle<Object> deadbands
+		 * @param std::string *error Set to the invalid path on failure
+		 * @return Deadband* NULL on failure
+		 */
+		static Deadband *compile(v8::Handle<v8::Object> deadbands, std::string *error);
+
+		~Deadband();
+
+		uint64_t compare(const IO::pumpDataReport *report, const IO::pumpSettingsReport *settings);
+
+		v8::Handle<v8::Object> changes(
+			uint64_t changed,
+			const IO::pumpDataReport *report,
+			const IO::pumpSettingsReport *settings
+		) const;
+
+	private:
+
+		Deadband();
+
+		struct Watch {
+			const SchemaField *field;
+			v8::Persistent<v8::String> key;
+			double deadband;
+			// index of the first element in emitted
+			size_t value;
+		};
+
+		std::vector<Watch> watches;
+
+		// values of the last emitted report, one per array element
+		std::vector<double> emitted;
+		bool initialized;
+
+};
+
+#endif
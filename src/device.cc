@@ -0,0 +1,354 @@
+/**
+ * An open pump and its cached state
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "device.h"
+#include "replay.h"
+#include "hidraw.h"
+
+Device::Device(Backend *backend) {
+
+	this->backend = backend;
+
+	settingsCached = false;
+	settingsTime = 0;
+	settingsTtl = 0;
+
+	uv_mutex_init(&lock);
+	uv_mutex_init(&settingsLock);
+
+	// a node doesn't move while it's open, so the path is read once
+	devicePathLength = backend->getDevicePath(devicePath, sizeof(devicePath));
+
+	if (devicePathLength < 0)
+		devicePath[0] = 0;
+};
+
+Device::~Device() {
+
+	delete backend;
+
+	uv_mutex_destroy(&lock);
+	uv_mutex_destroy(&settingsLock);
+};
+
+/**
+ * Opens the first matching device
+ *
+ * TRANSPORT_AUTO prefers hidraw, which reads a report with one ioctl, and
+ * falls back to hiddev if there is no accessible hidraw node.
+ *
+ * @param int vendorId
+ * @param int productId
+ * @param int transport One of the TRANSPORT_* constants
+ * @return Device* NULL if there is none
+ */
+Device *Device::open(int vendorId, int productId, int transport) {
+
+	if (transport != TRANSPORT_HIDDEV) {
+
+		HidrawBackend *backend = HidrawBackend::open(vendorId, productId);
+
+		if (backend || transport == TRANSPORT_HIDRAW)
+			return backend ? new Device(backend) : NULL;
+	}
+
+	int handle = IO::openDevice(vendorId, productId);
+
+	return handle < 0 ? NULL : new Device(new HiddevBackend(handle));
+};
+
+/**
+ * Lists the device nodes of all matching devices
+ *
+ * TRANSPORT_AUTO lists the accessible hidraw nodes like open() prefers
+ * them, and the hiddev nodes if there are none.
+ *
+ * @param int vendorId
+ * @param int productId
+ * @param int transport One of the TRANSPORT_* constants
+ * @param std::vector<std::string> *paths
+ * @return int Number of devices found
+ */
+int Device::enumerate(int vendorId, int productId, int transport, std::vector<std::string> *paths) {
+
+	if (transport != TRANSPORT_HIDDEV) {
+
+		std::vector<std::string> hidraw;
+		HidrawBackend::findDevices(vendorId, productId, &hidraw);
+
+		for (size_t i = 0; i < hidraw.size(); i++) {
+			if (transport == TRANSPORT_HIDRAW || access(hidraw[i].c_str(), R_OK | W_OK) == 0)
+				paths->push_back(hidraw[i]);
+		}
+
+		if (!paths->empty() || transport == TRANSPORT_HIDRAW)
+			return paths->size();
+	}
+
+	return IO::enumerate(vendorId, productId, paths);
+};
+
+/**
+ * Opens a device node
+ * @param const char *devicePath
+ * @param int vendorId
+ * @param int productId
+ * @return Device* NULL if it isn't a matching device
+ */
+Device *Device::open(const char *devicePath, int vendorId, int productId) {
+
+	if (strstr(devicePath, "hidraw")) {
+		HidrawBackend *backend = HidrawBackend::open(devicePath, vendorId, productId);
+		return backend ? new Device(backend) : NULL;
+	}
+
+	int handle = IO::openPath(devicePath, vendorId, productId);
+
+	return handle < 0 ? NULL : new Device(new HiddevBackend(handle));
+};
+
+/**
+ * Opens a recording instead of a device
+ * @param const char *path
+ * @param double rate Reads per second, 0 = as fast as possible
+ * @return Device* NULL if the recording can't be read
+ */
+Device *Device::openReplay(const char *path, double rate) {
+
+	ReplayBackend *backend = ReplayBackend::open(path, rate);
+
+	return backend ? new Device(backend) : NULL;
+};
+
+/**
+ * Reads the data report and the settings needed to convert it
+ *
+ * @param IO::pumpDataReport *data
+ * @param IO::pumpSettingsReport *settings
+ * @return int reportLength or one of the IO::ERROR_* codes
+ */
+int Device::readData(IO::pumpDataReport *data, IO::pumpSettingsReport *settings) {
+
+	backend->pace();
+
+	uv_mutex_lock(&lock);
+
+	// data conversion depends on the settings, which rarely change
+	int ret = readSettingsLocked(settings, true);
+
+	if (ret >= 0)
+		ret = backend->getFeatureReport(IO::DATA_REPORT, (unsigned char*) data, sizeof(*data));
+
+	if (ret >= 0 && backend->settingsChanged()) {
+
+		int length = ret;
+
+		ret = readSettingsLocked(settings, false);
+
+		if (ret >= 0)
+			ret = length;
+	}
+
+	uv_mutex_unlock(&lock);
+
+	return ret;
+};
+
+/**
+ * Reads the settings report
+ *
+ * @param IO::pumpSettingsReport *report
+ * @param bool cached Allow the cached report if it hasn't expired
+ * @return int reportLength or one of the IO::ERROR_* codes
+ */
+int Device::readSettings(IO::pumpSettingsReport *report, bool cached) {
+
+	if (!cached)
+		backend->pace();
+
+	uv_mutex_lock(&lock);
+	int ret = readSettingsLocked(report, cached);
+	uv_mutex_unlock(&lock);
+
+	return ret;
+};
+
+int Device::readSettingsLocked(IO::pumpSettingsReport *report, bool cached) {
+
+	if (cached) {
+
+		uint64_t now = uv_hrtime();
+		bool fresh;
+
+		uv_mutex_lock(&settingsLock);
+
+		fresh = settingsCached && (settingsTtl == 0 || now - settingsTime < settingsTtl);
+
+		if (fresh)
+			*report = settings;
+
+		uv_mutex_unlock(&settingsLock);
+
+		if (fresh)
+			return sizeof(*report);
+	}
+
+	int ret = backend->getFeatureReport(IO::SETTINGS_REPORT, (unsigned char*) report, sizeof(*report));
+
+	storeSettings(ret < 0 ? NULL : report);
+
+	return ret;
+};
+
+/**
+ * Replaces the cached settings, NULL drops them. Called with lock held.
+ * @param const IO::pumpSettingsReport *report
+ */
+void Device::storeSettings(const IO::pumpSettingsReport *report) {
+
+	uv_mutex_lock(&settingsLock);
+
+	if (report) {
+		settings = *report;
+		settingsTime = uv_hrtime();
+	}
+
+	settingsCached = report != NULL;
+
+	uv_mutex_unlock(&settingsLock);
+};
+
+/**
+ * Merges values over the current settings and writes the result, unless
+ * it's what the device already has
+ *
+ * The current settings are read from the device, so values changed by
+ * other software aren't written back. With a settingsTtl the cached
+ * report is used instead while it hasn't expired.
+ *
+ * @param const IO::pumpSettingsReport *values
+ * @param const IO::pumpSettingsReport *mask Bits of values to apply
+ * @param IO::pumpSettingsReport *before Set to the settings before the write
+ * @param IO::pumpSettingsReport *after Set to the merged settings
+ * @return int reportLength, 0 if nothing changed or one of the IO::ERROR_* codes
+ */
+int Device::writeSettings(
+	const IO::pumpSettingsReport *values,
+	const IO::pumpSettingsReport *mask,
+	IO::pumpSettingsReport *before,
+	IO::pumpSettingsReport *after
+) {
+
+	backend->pace();
+
+	uv_mutex_lock(&lock);
+
+	uv_mutex_lock(&settingsLock);
+	bool expires = settingsTtl != 0;
+	uv_mutex_unlock(&settingsLock);
+
+	// the default settingsTtl of 0 never expires, too stale to merge over
+	int ret = readSettingsLocked(before, expires);
+
+	if (ret < 0) {
+		uv_mutex_unlock(&lock);
+		return ret;
+	}
+
+	const unsigned char *value = (const unsigned char*) values;
+	const unsigned char *bits = (const unsigned char*) mask;
+	const unsigned char *current = (const unsigned char*) before;
+	unsigned char *merged = (unsigned char*) after;
+
+	for (size_t i = 0; i < sizeof(*after); i++)
+		merged[i] = (current[i] & ~bits[i]) | (value[i] & bits[i]);
+
+	if (!memcmp(before, after, sizeof(*after))) {
+		uv_mutex_unlock(&lock);
+		return 0;
+	}
+
+	ret = backend->setFeatureReport(IO::SETTINGS_REPORT, merged, sizeof(*after));
+
+	storeSettings(ret < 0 ? NULL : after);
+
+	uv_mutex_unlock(&lock);
+
+	return ret;
+};
+
+/**
+ * Reads a raw report, the settings report also refreshes the cache
+ *
+ * @param int reportId
+ * @param unsigned char *buffer
+ * @param size_t length
+ * @return int reportLength or one of the IO::ERROR_* codes
+ */
+int Device::readReport(int reportId, unsigned char *buffer, size_t length) {
+
+	if (reportId == IO::SETTINGS_REPORT && length >= sizeof(IO::pumpSettingsReport))
+		return readSettings((IO::pumpSettingsReport*) buffer, false);
+
+	backend->pace();
+
+	uv_mutex_lock(&lock);
+	int ret = backend->getFeatureReport(reportId, buffer, length);
+	uv_mutex_unlock(&lock);
+
+	return ret;
+};
+
+/**
+ * Copies the last known settings report, zeroed if there is none. Doesn't
+ * wait for a read in flight.
+ * @param IO::pumpSettingsReport *report
+ */
+void Device::cachedSettings(IO::pumpSettingsReport *report) {
+
+	uv_mutex_lock(&settingsLock);
+
+	if (settingsCached)
+		*report = settings;
+	else
+		memset(report, 0, sizeof(*report));
+
+	uv_mutex_unlock(&settingsLock);
+};
+
+/**
+ * @param uint64_t ttl Max age of the cached settings in ns, 0 = unlimited
+ */
+void Device::setSettingsTtl(uint64_t ttl) {
+
+	uv_mutex_lock(&settingsLock);
+	settingsTtl = ttl;
+	uv_mutex_unlock(&settingsLock);
+};
+
+int Device::getHandle() {
+	return backend->getHandle();
+};
+
+/**
+ * Copies the path read at open
+ * @param char *devicePath
+ * @param size_t length
+ * @return int length of the path, -1 on error
+ */
+int Device::getDevicePath(char *devicePath, size_t length) {
+
+	if (devicePathLength < 0 || (size_t) devicePathLength >= length)
+		return -1;
+
+	memcpy(devicePath, this->devicePath, devicePathLength + 1);
+
+	return devicePathLength;
+};
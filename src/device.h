@@ -0,0 +1,83 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <uv.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "io.h"
+#include "backend.h"
+
+/**
+ * An open pump
+ *
+ * Owns the handle and the cached settings report. All methods lock, so they
+ * may be called from any thread. cachedSettings() and getDevicePath() never
+ * wait for device I/O, so the event loop can use them.
+ */
+class Device {
+
+	public:
+
+		Device(Backend *backend);
+		~Device();
+
+		static const int TRANSPORT_AUTO = 0;
+		static const int TRANSPORT_HIDDEV = 1;
+		static const int TRANSPORT_HIDRAW = 2;
+
+		static Device *open(int vendorId, int productId, int transport);
+		static Device *open(const char *devicePath, int vendorId, int productId);
+		static Device *openReplay(const char *path, double rate);
+
+		static int enumerate(int vendorId, int productId, int transport, std::vector<std::string> *paths);
+
+		int readData(IO::pumpDataReport *data, IO::pumpSettingsReport *settings);
+		int readSettings(IO::pumpSettingsReport *report, bool cached);
+		int writeSettings(
+			const IO::pumpSettingsReport *values,
+			const IO::pumpSettingsReport *mask,
+			IO::pumpSettingsReport *before,
+			IO::pumpSettingsReport *after
+		);
+		int readReport(int reportId, unsigned char *buffer, size_t length);
+
+		void cachedSettings(IO::pumpSettingsReport *report);
+		void setSettingsTtl(uint64_t ttl);
+
+		int getHandle();
+		int getDevicePath(char *devicePath, size_t length);
+
+	private:
+
+		int readSettingsLocked(IO::pumpSettingsReport *report, bool cached);
+		void storeSettings(const IO::pumpSettingsReport *report);
+
+		Backend *backend;
+
+		// serializes device access between threads, held across I/O
+		uv_mutex_t lock;
+
+		// guards the settings cache below, never held across I/O; taken
+		// after lock if both are needed
+		uv_mutex_t settingsLock;
+
+		IO::pumpSettingsReport settings;
+		bool settingsCached;
+		uint64_t settingsTime;
+
+		// max age of the cached settings in ns, 0 = until the next write
+		uint64_t settingsTtl;
+
+		// read once at open, empty if the backend has none
+		char devicePath[PATH_MAX];
+		int devicePathLength;
+
+};
+
+#endif
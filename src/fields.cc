@@ -0,0 +1,374 @@
+/**
+ * Report field tables and their conversions, without V8
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include "schema.h"
+#include "convert.h"
+
+/**
+ * Fields of the data report, in the order of the result object
+ * VALUE(path, struct member, conversion), ARRAY(...) for arrays, BITS(...) for bitfields,
+ * HIDDEN(struct member) for members without a property, they are only in the layout
+ *
+ * Every entry is expanded into its own accessors below, so adding a member
+ * here adds it to getData(), setSettings(), the history and the layout.
+ */
+#define DATA_FIELDS(VALUE, ARRAY, BITS, HIDDEN) \
+	HIDDEN(rawSensorData[0]) \
+	HIDDEN(rawSensorData[1]) \
+	HIDDEN(rawSensorData[2]) \
+	VALUE("controller.i", controllerI, CONTROLLER) \
+	VALUE("controller.p", controllerP, CONTROLLER) \
+	VALUE("controller.d", controllerD, CONTROLLER) \
+	VALUE("controller.output", controllerOut, CONTROLLER) \
+	VALUE("current.flow", flow, RAW) \
+	VALUE("current.frequency", frequency, FREQUENCY) \
+	VALUE("current.frequencyMax", frequencyMax, FAN_RPM) \
+	VALUE("current.fanVoltageMeasured", rawSensorData[3], FAN_VOLTAGE) \
+	VALUE("current.fanVoltage", rawSensorData[4], FAN_OUTPUT_VOLTAGE) \
+	VALUE("current.voltage", rawSensorData[4], VOLTAGE) \
+	VALUE("current.pumpCurrent", rawSensorData[5], CURRENT) \
+	VALUE("current.pumpPower", rawSensorData[5], PUMP_POWER) \
+	VALUE("current.fanRpm", fanRpm, FAN_RPM) \
+	VALUE("current.fanPower", fanPower, PERCENT) \
+	VALUE("current.temperature.pump", temperatureRaw[0], TEMPERATURE) \
+	VALUE("current.temperature.external", temperatureRaw[1], TEMPERATURE) \
+	VALUE("current.temperature.water", temperatureRaw[2], TEMPERATURE) \
+	BITS("alarm.sensor0", alarmSensor0, RAW) \
+	BITS("alarm.sensor1", alarmSensor1, RAW) \
+	BITS("alarm.fan", alarmFan, RAW) \
+	BITS("alarm.flow", alarmFlow, RAW) \
+	BITS("mode.advancedPumpSettings", modeAdvancedPumpSettings, RAW) \
+	BITS("mode.aquastreamModeAdvanced", modeAquastreamModeAdvanced, RAW) \
+	BITS("mode.aquastreamModeUltra", modeAquastreamModeUltra, RAW) \
+	VALUE("hardware.firmware", firmware, RAW) \
+	VALUE("hardware.bootloader", bootloader, RAW) \
+	VALUE("hardware.hardware", hardware, RAW) \
+	VALUE("hardware.serial", serial, RAW) \
+	ARRAY("hardware.publicKey", publicKey, HEX)
+
+/**
+ * Fields of the settings report, in the order of the result object
+ */
+#define SETTINGS_FIELDS(VALUE, ARRAY, BITS, HIDDEN) \
+	BITS("pumpMode.deaeration", pumpMode_deaeration, RAW) \
+	BITS("pumpMode.autoPumpMaxFrequency", pumpMode_autoPumpMaxFreq, RAW) \
+	BITS("pumpMode.deaerationModeSensor", pumpMode_deaerationModeSens, RAW) \
+	BITS("pumpMode.resetPumpMaxFrequency", pumpMode_resetPumpMaxFreq, RAW) \
+	BITS("pumpMode.i2cControl", pumpMode_i2cControl, RAW) \
+	BITS("pumpMode.minFrequencyForce", pumpMode_minFreqForce, RAW) \
+	VALUE("pumpMode.pumpModeB", pumpModeB, RAW) \
+	VALUE("i2c.address", i2cAddress, RAW) \
+	BITS("i2c.settingAquabusEnable", i2cSetting_aquabusEnable, RAW) \
+	VALUE("sensorBridge", sensorBridge, RAW) \
+	VALUE("measureFanEdges", measureFanEdges, RAW) \
+	VALUE("measureFlowEdges", measureFlowEdges, RAW) \
+	VALUE("frequency.pump.current", pumpFrequency, FREQUENCY) \
+	VALUE("frequency.pump.min", minPumpFrequency, FREQUENCY) \
+	VALUE("frequency.pump.max", maxPumpFrequency, FREQUENCY) \
+	VALUE("frequency.resetCycle", frequencyResetCycle, RESET_CYCLE) \
+	BITS("alarm.sensor0", alarm_sensor0, RAW) \
+	BITS("alarm.sensor1", alarm_sensor1, RAW) \
+	BITS("alarm.pump", alarm_pump, RAW) \
+	BITS("alarm.fan", alarm_fan, RAW) \
+	BITS("alarm.flow", alarm_flow, RAW) \
+	BITS("alarm.fanShort", alarm_fanShort, RAW) \
+	BITS("alarm.fanOverTemp70", alarm_fanOverTemp70, RAW) \
+	BITS("alarm.fanOverTemp90", alarm_fanOverTemp90, RAW) \
+	BITS("tacho.mode.linkFan", tachoMode_linkFan, RAW) \
+	BITS("tacho.mode.linkFlow", tachoMode_linkFlow, RAW) \
+	BITS("tacho.mode.linkPump", tachoMode_linkPump, RAW) \
+	BITS("tacho.mode.linkStatic", tachoMode_linkStatic, RAW) \
+	BITS("tacho.mode.linkAlarmInterrupt", tachoMode_linkAlarmInterrupt, RAW) \
+	VALUE("tacho.frequency", tachoFrequency, TACHO) \
+	VALUE("tacho.flowAlarmValue", flowAlarmValue, RAW) \
+	ARRAY("sensorAlarmTemperature", sensorAlarmTemperature, TEMPERATURE) \
+	BITS("fanMode.manual", fanMode_manual, RAW) \
+	BITS("fanMode.auto", fanMode_auto, RAW) \
+	BITS("fanMode.holdMinPower", fanMode_holdMinPower, RAW) \
+	VALUE("fanManualPower", fanManualPower, PERCENT) \
+	VALUE("controller.hysterese", controllerHysterese, TEMPERATURE) \
+	VALUE("controller.sensor", controllerSensor, RAW) \
+	VALUE("controller.setTemp", controllerSetTemp, TEMPERATURE) \
+	VALUE("controller.P", controllerP, RAW) \
+	VALUE("controller.I", controllerI, RAW) \
+	VALUE("controller.D", controllerD, RAW) \
+	VALUE("sensorMinTemperature", sensorMinTemperature, TEMPERATURE) \
+	VALUE("sensorMaxTemperature", sensorMaxTemperature, TEMPERATURE) \
+	VALUE("fanMinimumPower", fanMinimumPower, RAW) \
+	VALUE("fanMaximumPower", fanMaximumPower, RAW) \
+	VALUE("ledSettings", ledSettings, RAW) \
+	VALUE("aquabusTimeout", aquabusTimeout, RAW)
+
+
+#define DATA(report) ((const IO::pumpDataReport*) report)
+
+/**
+ * Conversion of a raw value, specialized for every SchemaConversion
+ *
+ * DERIVED conversions also read another member of the data report.
+ */
+template <int conversion> struct Conversion {
+	static const bool DERIVED = false;
+	static double number(u_int32_t raw, const unsigned char *, const IO::pumpSettingsReport *) {
+		return raw;
+	}
+};
+
+#define CONVERSION(conversion, derived, expression) \
+	template <> struct Conversion<CONVERT_##conversion> { \
+		static const bool DERIVED = derived; \
+		static double number(u_int32_t raw, const unsigned char *report, const IO::pumpSettingsReport *settings) { \
+			return expression; \
+		} \
+	};
+
+CONVERSION(TEMPERATURE, false, Convert::temperature(raw))
+CONVERSION(FREQUENCY, false, (int) Convert::frequency(raw))
+CONVERSION(RESET_CYCLE, false, Convert::frequencyResetCycle(raw))
+CONVERSION(TACHO, false, Convert::staticTachoRpm(raw))
+CONVERSION(PERCENT, false, Convert::scalePercent(raw))
+CONVERSION(FAN_RPM, false, Convert::fanRpm(raw, settings->measureFanEdges))
+CONVERSION(FAN_VOLTAGE, false, Convert::fanVoltage(raw))
+CONVERSION(FAN_OUTPUT_VOLTAGE, true, Convert::voltage(raw) * (Convert::scalePercent(DATA(report)->fanPower) / 100))
+CONVERSION(VOLTAGE, false, Convert::voltage(raw))
+CONVERSION(CURRENT, false, Convert::current(raw))
+CONVERSION(PUMP_POWER, true, (Convert::current(raw) * Convert::voltage(DATA(report)->rawSensorData[4])) / 1000)
+CONVERSION(CONTROLLER, false, Convert::controllerOutScale((int32_t) raw))
+
+#define MEMBER_SIZE(report, field) sizeof(((report*)0)->field)
+#define MEMBER_SIGNED(report, field) (((__typeof__(((report*)0)->field)) -1) < 0)
+
+/**
+ * Entry id of the table, ids are counted from the first entry
+ */
+template <int id> struct DataField;
+template <int id> struct SettingsField;
+
+/**
+ * The accessors of one entry: element is the member expression of element
+ * i, layout the offset, size, count and sign of the member for
+ * getReportLayout(). Everything is plain member access, the compiler
+ * handles bitfields and widths.
+ */
+#define FIELD(table, report, path, field, element, layout, bitfield, conversion) \
+	template <> struct table<__COUNTER__ - table##First> { \
+		enum { COUNT = layout##_COUNT(report, field) }; \
+		static u_int32_t raw(const unsigned char *data, size_t i) { \
+			return ((const report*) data)->element; \
+		} \
+		static void store(unsigned char *data, size_t i, u_int32_t value) { \
+			((report*) data)->element = value; \
+		} \
+		static double convert(u_int32_t value, const unsigned char *data, const IO::pumpSettingsReport *settings) { \
+			return Conversion<CONVERT_##conversion>::number(value, data, settings); \
+		} \
+		static double number(const unsigned char *data, size_t i, const IO::pumpSettingsReport *settings) { \
+			return convert(raw(data, i), data, settings); \
+		} \
+		static SchemaField entry() { \
+			SchemaField entry = { path, #field, layout(report, field), 0, 0, bitfield, CONVERT_##conversion, \
+				Conversion<CONVERT_##conversion>::DERIVED, raw, store, convert, number }; \
+			return entry; \
+		} \
+	};
+
+// offset, size, count, sign
+#define VALUE_LAYOUT(report, field) offsetof(report, field), MEMBER_SIZE(report, field), 1, MEMBER_SIGNED(report, field)
+#define VALUE_LAYOUT_COUNT(report, field) 1
+#define ARRAY_LAYOUT(report, field) offsetof(report, field), MEMBER_SIZE(report, field[0]), \
+	MEMBER_SIZE(report, field) / MEMBER_SIZE(report, field[0]), MEMBER_SIGNED(report, field[0])
+#define ARRAY_LAYOUT_COUNT(report, field) MEMBER_SIZE(report, field) / MEMBER_SIZE(report, field[0])
+// bitfields can't be used with offsetof, layout() finds them
+#define BITS_LAYOUT(report, field) 0, 1, 1, false
+#define BITS_LAYOUT_COUNT(report, field) 1
+
+#define IGNORE(path, field, conversion)
+#define IGNORE_HIDDEN(field)
+
+#define DATA_VALUE(path, field, conversion) \
+	FIELD(DataField, IO::pumpDataReport, path, field, field, VALUE_LAYOUT, false, conversion)
+#define DATA_ARRAY(path, field, conversion) \
+	FIELD(DataField, IO::pumpDataReport, path, field, field[i], ARRAY_LAYOUT, false, conversion)
+#define DATA_BITS(path, field, conversion) \
+	FIELD(DataField, IO::pumpDataReport, path, field, field, BITS_LAYOUT, true, conversion)
+
+#define SETTINGS_VALUE(path, field, conversion) \
+	FIELD(SettingsField, IO::pumpSettingsReport, path, field, field, VALUE_LAYOUT, false, conversion)
+#define SETTINGS_ARRAY(path, field, conversion) \
+	FIELD(SettingsField, IO::pumpSettingsReport, path, field, field[i], ARRAY_LAYOUT, false, conversion)
+#define SETTINGS_BITS(path, field, conversion) \
+	FIELD(SettingsField, IO::pumpSettingsReport, path, field, field, BITS_LAYOUT, true, conversion)
+
+static const int DataFieldFirst = __COUNTER__ + 1;
+DATA_FIELDS(DATA_VALUE, DATA_ARRAY, DATA_BITS, IGNORE_HIDDEN)
+static const int DATA_FIELD_COUNT = __COUNTER__ - DataFieldFirst;
+
+static const int SettingsFieldFirst = __COUNTER__ + 1;
+SETTINGS_FIELDS(SETTINGS_VALUE, SETTINGS_ARRAY, SETTINGS_BITS, IGNORE_HIDDEN)
+static const int SETTINGS_FIELD_COUNT = __COUNTER__ - SettingsFieldFirst;
+
+/**
+ * Unrolls the first count entries of a table at compile time
+ */
+template <template <int> class Table, int count> struct Fields {
+
+	enum { ELEMENTS = Fields<Table, count - 1>::ELEMENTS + Table<count - 1>::COUNT };
+
+	static void fill(SchemaField *fields) {
+		Fields<Table, count - 1>::fill(fields);
+		fields[count - 1] = Table<count - 1>::entry();
+	}
+
+	static double *numbers(const unsigned char *report, const IO::pumpSettingsReport *settings, double *values) {
+
+		values = Fields<Table, count - 1>::numbers(report, settings, values);
+
+		for (int i = 0; i < Table<count - 1>::COUNT; i++)
+			values[i] = Table<count - 1>::number(report, i, settings);
+
+		return values + Table<count - 1>::COUNT;
+	}
+};
+
+template <template <int> class Table> struct Fields<Table, 0> {
+
+	enum { ELEMENTS = 0 };
+
+	static void fill(SchemaField *) {}
+
+	static double *numbers(const unsigned char *, const IO::pumpSettingsReport *, double *values) {
+		return values;
+	}
+};
+
+typedef Fields<DataField, DATA_FIELD_COUNT> DataFields;
+typedef Fields<SettingsField, SETTINGS_FIELD_COUNT> SettingsFields;
+
+// fails to compile if a report has more elements than Schema::MAX_ELEMENTS
+typedef char elementsFit[
+	DataFields::ELEMENTS <= Schema::MAX_ELEMENTS && SettingsFields::ELEMENTS <= Schema::MAX_ELEMENTS ? 1 : -1
+];
+
+static SchemaField dataFields[DATA_FIELD_COUNT];
+static SchemaField settingsFields[SETTINGS_FIELD_COUNT];
+
+static bool fill() {
+	DataFields::fill(dataFields);
+	SettingsFields::fill(settingsFields);
+	return true;
+}
+
+// filled while the library loads, before anything can call fields()
+static bool filled = fill();
+
+/**
+ * Returns the field table of a report
+ * @param int reportId
+ * @param size_t *count
+ * @return const SchemaField* NULL for unknown reports
+ */
+const SchemaField *Schema::fields(int reportId, size_t *count) {
+
+	switch (reportId) {
+		case IO::DATA_REPORT:
+			*count = DATA_FIELD_COUNT;
+			return dataFields;
+		case IO::SETTINGS_REPORT:
+			*count = SETTINGS_FIELD_COUNT;
+			return settingsFields;
+	}
+
+	*count = 0;
+	return NULL;
+};
+
+/**
+ * Converts every element of a report in table order, arrays take one slot
+ * per element. The loop over the table is unrolled at compile time.
+ * @param int reportId
+ * @param const unsigned char *report
+ * @param const IO::pumpSettingsReport *settings Needed for fan rpm
+ * @param double *values Schema::MAX_ELEMENTS slots
+ * @return size_t Number of values, 0 for unknown reports
+ */
+size_t Schema::numbers(int reportId, const unsigned char *report, const IO::pumpSettingsReport *settings, double *values) {
+
+	switch (reportId) {
+		case IO::DATA_REPORT:
+			return DataFields::numbers(report, settings, values) - values;
+		case IO::SETTINGS_REPORT:
+			return SettingsFields::numbers(report, settings, values) - values;
+	}
+
+	return 0;
+};
+
+// orders layout entries like the members of the report struct
+static bool compareOffset(const SchemaField &a, const SchemaField &b) {
+	return a.offset < b.offset || (a.offset == b.offset && a.bit < b.bit);
+}
+
+// fields sharing a member, like rawSensorData[4] for two properties
+static bool sameMember(const SchemaField &a, const SchemaField &b) {
+	return a.offset == b.offset && a.bit == b.bit;
+}
+
+#define HIDDEN_FIELD(report, field) \
+	{ SchemaField hidden = { NULL, #field, VALUE_LAYOUT(report, field), 0, 0, false, CONVERT_RAW, false, NULL, NULL, NULL, NULL }; \
+		layout->push_back(hidden); }
+#define DATA_HIDDEN(field) HIDDEN_FIELD(IO::pumpDataReport, field)
+#define SETTINGS_HIDDEN(field) HIDDEN_FIELD(IO::pumpSettingsReport, field)
+
+/**
+ * Lists every member of a report once, in struct order, for
+ * IO::getReportLayout(). Hidden members have no path.
+ * @param int reportId
+ * @param std::vector<SchemaField> *layout
+ */
+void Schema::layout(int reportId, std::vector<SchemaField> *layout) {
+
+	size_t count;
+	const SchemaField *table = fields(reportId, &count);
+
+	layout->assign(table, table + count);
+
+	// a bitfield is where storing all ones sets bits in a zeroed report
+	for (size_t i = 0; i < layout->size(); i++) {
+
+		SchemaField *field = &(*layout)[i];
+
+		if (!field->bitfield)
+			continue;
+
+		unsigned char report[IO::REPORT_LENGTH];
+		memset(report, 0, sizeof(report));
+		field->store(report, 0, ~0u);
+
+		for (field->offset = 0; !report[field->offset]; field->offset++);
+
+		while (!(report[field->offset] & (1 << field->bit)))
+			field->bit++;
+
+		while (field->bit + field->bits < 8 && (report[field->offset] & (1 << (field->bit + field->bits))))
+			field->bits++;
+	}
+
+	switch (reportId) {
+		case IO::DATA_REPORT:
+			DATA_FIELDS(IGNORE, IGNORE, IGNORE, DATA_HIDDEN)
+		break;
+		case IO::SETTINGS_REPORT:
+			SETTINGS_FIELDS(IGNORE, IGNORE, IGNORE, SETTINGS_HIDDEN)
+		break;
+	}
+
+	std::sort(layout->begin(), layout->end(), compareOffset);
+	layout->erase(std::unique(layout->begin(), layout->end(), sameMember), layout->end());
+};
@@ -0,0 +1,229 @@
+/**
+ * Multi pump manager
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <v8.h>
+#include <stdio.h>
+
+#include "group.h"
+#include "async.h"
+#include "io.h"
+#include "sampler.h"
+
+using namespace v8;
+
+/**
+ * State of one read() call
+ */
+struct TickBaton {
+	AquastreamGroup *group;
+	Persistent<Function> callback;
+	Persistent<Object> snapshot;
+	uint64_t timestamp;
+	size_t pending;
+};
+
+/**
+ * Read of a single device within a tick
+ */
+struct DeviceBaton {
+	uv_work_t request;
+	TickBaton *tick;
+	Device *device;
+	const std::string *devicePath;
+	int error;
+	uint64_t timestamp;
+	IO::pumpDataReport data;
+	IO::pumpSettingsReport settings;
+};
+
+AquastreamGroup::AquastreamGroup() {};
+
+AquastreamGroup::~AquastreamGroup() {
+
+	for (size_t i = 0; i < devices.size(); i++)
+		delete devices[i];
+};
+
+void AquastreamGroup::Init(Handle<Object> target) {
+
+	// Prepare constructor template
+	Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+	tpl->SetClassName(String::NewSymbol("AquastreamGroup"));
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+	// Prototype
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("read"),
+		FunctionTemplate::New(Read)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("getDevices"),
+		FunctionTemplate::New(GetDevices)->GetFunction()
+	);
+
+	Persistent<Function> constructor = Persistent<Function>::New(tpl->GetFunction());
+	target->Set(String::NewSymbol("AquastreamGroup"), constructor);
+};
+
+/**
+ * new AquastreamGroup(vendorId, productId)
+ *
+ * Opens every matching device
+ */
+Handle<Value> AquastreamGroup::New(const Arguments& args) {
+
+	HandleScope scope;
+
+	if (!args[0]->IsNumber() || !args[1]->IsNumber()) {
+		ThrowException(Exception::TypeError(String::New("Invalid vendor or product id")));
+		return scope.Close(Undefined());
+	}
+
+	int vendorId = args[0]->Int32Value();
+	int productId = args[1]->Int32Value();
+
+	std::vector<std::string> paths;
+	Device::enumerate(vendorId, productId, Device::TRANSPORT_AUTO, &paths);
+
+	AquastreamGroup *group = new AquastreamGroup();
+
+	for (size_t i = 0; i < paths.size(); i++) {
+
+		Device *device = Device::open(paths[i].c_str(), vendorId, productId);
+
+		if (device) {
+			group->devices.push_back(device);
+			group->devicePaths.push_back(paths[i]);
+		}
+	}
+
+	if (group->devices.empty()) {
+		delete group;
+		ThrowException(Exception::Error(String::New("Couldn't find Aquastream XT!")));
+		return scope.Close(Undefined());
+	}
+
+	group->Wrap(args.This());
+
+	return args.This();
+};
+
+/**
+ * read([callback])
+ *
+ * Reads the data report of every device in parallel on the libuv threadpool,
+ * so a tick takes as long as the slowest device. Callback gets
+ * (err, { timestamp, devices: { <serial>: { timestamp, devicePath, data } },
+ * errors: { <devicePath>: message } }), timestamps in ms.
+ * Returns a Promise if no callback is given.
+ */
+Handle<Value> AquastreamGroup::Read(const Arguments& args) {
+
+	HandleScope scope;
+
+	Local<Value> returnValue = Local<Value>::New(Undefined());
+	Local<Function> cb = Async::callback(args[0], &returnValue);
+
+	if (cb.IsEmpty())
+		return scope.Close(Undefined());
+
+	AquastreamGroup *group = ObjectWrap::Unwrap<AquastreamGroup>(args.This());
+
+	Local<Object> snapshot = Object::New();
+	snapshot->Set(String::NewSymbol("devices"), Object::New());
+	snapshot->Set(String::NewSymbol("errors"), Object::New());
+
+	TickBaton *tick = new TickBaton();
+	tick->group = group;
+	tick->callback = Persistent<Function>::New(cb);
+	tick->snapshot = Persistent<Object>::New(snapshot);
+	tick->timestamp = Sampler::now();
+	tick->pending = group->devices.size();
+
+	group->Ref();
+
+	for (size_t i = 0; i < group->devices.size(); i++) {
+
+		DeviceBaton *baton = new DeviceBaton();
+		baton->request.data = baton;
+		baton->tick = tick;
+		baton->device = group->devices[i];
+		baton->devicePath = &group->devicePaths[i];
+		baton->error = 0;
+
+		uv_queue_work(uv_default_loop(), &baton->request, ReadWork, ReadAfter);
+	}
+
+	return scope.Close(returnValue);
+};
+
+void AquastreamGroup::ReadWork(uv_work_t *request) {
+
+	DeviceBaton *baton = static_cast<DeviceBaton*>(request->data);
+
+	baton->error = baton->device->readData(&baton->data, &baton->settings);
+	baton->timestamp = Sampler::now();
+};
+
+void AquastreamGroup::ReadAfter(uv_work_t *request, int status) {
+
+	HandleScope scope;
+
+	DeviceBaton *baton = static_cast<DeviceBaton*>(request->data);
+	TickBaton *tick = baton->tick;
+
+	if (baton->error < 0) {
+		tick->snapshot->Get(String::NewSymbol("errors"))->ToObject()->Set(
+			String::New(baton->devicePath->c_str()),
+			String::New(IO::errorString(baton->error))
+		);
+	} else {
+		char serial[8];
+		snprintf(serial, sizeof(serial), "%u", baton->data.serial);
+
+		Local<Object> device = Object::New();
+		device->Set(String::NewSymbol("timestamp"), Number::New(baton->timestamp / 1e6));
+		device->Set(String::NewSymbol("devicePath"), String::New(baton->devicePath->c_str()));
+		device->Set(String::NewSymbol("data"), IO::getData(&baton->data, &baton->settings));
+
+		tick->snapshot->Get(String::NewSymbol("devices"))->ToObject()->Set(String::New(serial), device);
+	}
+
+	delete baton;
+
+	if (--tick->pending > 0)
+		return;
+
+	tick->snapshot->Set(String::NewSymbol("timestamp"), Number::New(tick->timestamp / 1e6));
+
+	Async::complete(tick->callback, Null(), tick->snapshot);
+
+	tick->group->Unref();
+	tick->callback.Dispose();
+	tick->snapshot.Dispose();
+	delete tick;
+};
+
+/**
+ * getDevices()
+ *
+ * Returns the device paths of the group
+ */
+Handle<Value> AquastreamGroup::GetDevices(const Arguments& args) {
+
+	HandleScope scope;
+
+	AquastreamGroup *group = ObjectWrap::Unwrap<AquastreamGroup>(args.This());
+	Local<Array> paths = Array::New(group->devicePaths.size());
+
+	for (size_t i = 0; i < group->devicePaths.size(); i++)
+		paths->Set(i, String::New(group->devicePaths[i].c_str()));
+
+	return scope.Close(paths);
+};
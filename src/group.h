@@ -0,0 +1,40 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <node.h>
+#include <uv.h>
+#include <string>
+#include <vector>
+
+#include "device.h"
+
+/**
+ * All pumps matching a vendor / product id, read in parallel
+ */
+class AquastreamGroup: public node::ObjectWrap {
+
+	public:
+		static void Init(v8::Handle<v8::Object> target);
+
+	private:
+		AquastreamGroup();
+		~AquastreamGroup();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Read(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetDevices(const v8::Arguments& args);
+
+	static void ReadWork(uv_work_t *request);
+	static void ReadAfter(uv_work_t *request, int status);
+
+	std::vector<Device*> devices;
+	std::vector<std::string> devicePaths;
+
+};
+
+#endif
@@ -0,0 +1,235 @@
+/**
+ * hidraw transport
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <linux/hidraw.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "hidraw.h"
+#include "io.h"
+#include "stats.h"
+
+HidrawBackend::HidrawBackend(int handle) {
+
+	this->handle = handle;
+
+	// probe the known reports once, like HiddevBackend
+	reportLength(IO::DATA_REPORT);
+	reportLength(IO::SETTINGS_REPORT);
+};
+
+HidrawBackend::~HidrawBackend() {
+
+	if (handle >= 0)
+		close(handle);
+};
+
+/**
+ * Lists the hidraw nodes of all matching devices, ids are read from the
+ * uevent file in sysfs
+ *
+ * @param int vendorId
+ * @param int productId
+ * @param std::vector<std::string> *paths
+ * @return int Number of devices found, -1 if sysfs isn't available
+ */
+int HidrawBackend::findDevices(int vendorId, int productId, std::vector<std::string> *paths) {
+
+	DIR *dir = opendir("/sys/class/hidraw");
+
+	if (!dir)
+		return -1;
+
+	std::vector<int> minors;
+	struct dirent *entry;
+	char path[PATH_MAX], line[128];
+
+	while ((entry = readdir(dir))) {
+
+		if (strncmp(entry->d_name, "hidraw", 6))
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent", entry->d_name);
+
+		FILE *file = fopen(path, "r");
+
+		if (!file)
+			continue;
+
+		unsigned int bus, vendor, product;
+
+		while (fgets(line, sizeof(line), file)) {
+			if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product) == 3) {
+				if ((int) vendor == vendorId && (int) product == productId)
+					minors.push_back(atoi(entry->d_name + 6));
+				break;
+			}
+		}
+
+		fclose(file);
+	}
+
+	closedir(dir);
+
+	std::sort(minors.begin(), minors.end());
+
+	for (size_t i = 0; i < minors.size(); i++) {
+		snprintf(path, sizeof(path), "/dev/hidraw%d", minors[i]);
+		paths->push_back(path);
+	}
+
+	return paths->size();
+};
+
+/**
+ * Opens a hidraw node if it's a matching device
+ * @param const char *devicePath
+ * @param int vendorId
+ * @param int productId
+ * @return HidrawBackend* NULL otherwise
+ */
+HidrawBackend *HidrawBackend::open(const char *devicePath, int vendorId, int productId) {
+
+	int handle = ::open(devicePath, O_RDWR);
+
+	if (handle < 0)
+		return NULL;
+
+	struct hidraw_devinfo info;
+
+	if (
+		ioctl(handle, HIDIOCGRAWINFO, &info) < 0 ||
+		(info.vendor & 0xffff) != vendorId ||
+		(info.product & 0xffff) != productId
+	) {
+		close(handle);
+		return NULL;
+	}
+
+	return new HidrawBackend(handle);
+};
+
+/**
+ * Opens the first matching device
+ * @param int vendorId
+ * @param int productId
+ * @return HidrawBackend* NULL if there is none or it can't be opened
+ */
+HidrawBackend *HidrawBackend::open(int vendorId, int productId) {
+
+	std::vector<std::string> paths;
+	findDevices(vendorId, productId, &paths);
+
+	for (size_t i = 0; i < paths.size(); i++) {
+
+		HidrawBackend *backend = open(paths[i].c_str(), vendorId, productId);
+
+		if (backend)
+			return backend;
+	}
+
+	return NULL;
+};
+
+/**
+ * Returns the cached length of a report including the report id, the
+ * kernel returns the actual length when asked for the maximum
+ * @param int reportId
+ * @return int length or IO::ERROR_GET_REPORT
+ */
+int HidrawBackend::reportLength(int reportId) {
+
+	std::map<int, int>::iterator it = reportLengths.find(reportId);
+
+	if (it != reportLengths.end())
+		return it->second;
+
+	unsigned char buffer[IO::REPORT_LENGTH + 1];
+	buffer[0] = reportId;
+
+	uint64_t start = Stats::now();
+	int ret = ioctl(handle, HIDIOCGFEATURE(sizeof(buffer)), buffer);
+	Stats::record(Stats::IOCTL_GET_FEATURE, start, ret < 0);
+
+	if (ret <= 0)
+		return IO::ERROR_GET_REPORT;
+
+	reportLengths[reportId] = ret;
+
+	return ret;
+};
+
+/**
+ * @return int Bytes read including the report id, like the hiddev report
+ * length, or one of the IO::ERROR_* codes
+ */
+int HidrawBackend::getFeatureReport(int reportId, unsigned char *buffer, size_t length) {
+
+	int reportLength = this->reportLength(reportId);
+
+	if (reportLength < 0)
+		return reportLength;
+
+	unsigned char report[IO::REPORT_LENGTH + 1];
+	report[0] = reportId;
+
+	uint64_t start = Stats::now();
+	int ret = ioctl(handle, HIDIOCGFEATURE(reportLength), report);
+	Stats::record(Stats::IOCTL_GET_FEATURE, start, ret < 0);
+
+	if (ret <= 0)
+		return IO::ERROR_GET_REPORT;
+
+	size_t size = ret - 1;
+
+	memcpy(buffer, report + 1, size < length ? size : length);
+
+	if (size < length)
+		memset(buffer + size, 0, length - size);
+
+	return ret;
+};
+
+/**
+ * @return int Bytes written including the report id or one of the IO::ERROR_* codes
+ */
+int HidrawBackend::setFeatureReport(int reportId, const unsigned char *buffer, size_t length) {
+
+	int reportLength = this->reportLength(reportId);
+
+	if (reportLength < 0)
+		return reportLength;
+
+	// the rest of the report is zeroed, like with hiddev
+	unsigned char report[IO::REPORT_LENGTH + 1];
+	size_t size = reportLength - 1;
+
+	report[0] = reportId;
+	memset(report + 1, 0, size);
+	memcpy(report + 1, buffer, length < size ? length : size);
+
+	uint64_t start = Stats::now();
+	int ret = ioctl(handle, HIDIOCSFEATURE(reportLength), report);
+	Stats::record(Stats::IOCTL_SET_FEATURE, start, ret < 0);
+
+	return ret < 0 ? IO::ERROR_SET_REPORT : ret;
+};
+
+int HidrawBackend::getDevicePath(char *devicePath, size_t length) {
+	return IO::getDevicePath(handle, devicePath, length);
+};
+
+int HidrawBackend::getHandle() {
+	return handle;
+};
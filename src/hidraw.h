@@ -0,0 +1,50 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef HIDRAW_H
+#define HIDRAW_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+/**
+ * The hidraw interface
+ *
+ * Feature reports are transferred as one byte buffer with HIDIOCGFEATURE /
+ * HIDIOCSFEATURE, instead of one 32 bit usage per byte like with hiddev.
+ * Needs read / write access to the /dev/hidraw* node.
+ */
+class HidrawBackend: public Backend {
+
+	public:
+
+		~HidrawBackend();
+
+		static HidrawBackend *open(int vendorId, int productId);
+		static HidrawBackend *open(const char *devicePath, int vendorId, int productId);
+		static int findDevices(int vendorId, int productId, std::vector<std::string> *paths);
+
+		int getFeatureReport(int reportId, unsigned char *buffer, size_t length);
+		int setFeatureReport(int reportId, const unsigned char *buffer, size_t length);
+		int getDevicePath(char *devicePath, size_t length);
+		int getHandle();
+
+	private:
+
+		HidrawBackend(int handle);
+
+		int reportLength(int reportId);
+
+		int handle;
+
+		// report lengths including the report id by report id, fixed while the device is open
+		std::map<int, int> reportLengths;
+
+};
+
+#endif
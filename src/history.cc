@@ -0,0 +1,338 @@
+/**
+ * Native time series store
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <v8.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "history.h"
+#include "convert.h"
+#include "typedarray.h"
+
+using namespace v8;
+
+/**
+ * Whether a field gets a column: not the hardware info, which doesn't
+ * change, and no arrays or values derived from two members, a column
+ * converts on its own
+ */
+static bool storable(const SchemaField *field) {
+	return field->count == 1 && !field->derived && strncmp(field->path, "hardware.", 9);
+}
+
+// upper bound for the number of buckets of a query
+static const size_t MAX_BUCKETS = 1000000;
+
+/**
+ * Converts count consecutive stored values of a column, with the batch
+ * conversions where there is one
+ */
+static void convertSpan(
+	const SchemaField *field,
+	const unsigned char *values,
+	size_t count,
+	const IO::pumpSettingsReport *settings,
+	double *out
+) {
+
+	switch(field->conversion) {
+		case CONVERT_TEMPERATURE:
+			Convert::temperature((const u_int16_t*) values, out, count);
+			return;
+		case CONVERT_FAN_RPM:
+			if (field->size == sizeof(u_int16_t))
+				Convert::fanRpm((const u_int16_t*) values, settings->measureFanEdges, out, count);
+			else
+				Convert::fanRpm((const u_int32_t*) values, settings->measureFanEdges, out, count);
+			return;
+		case CONVERT_FAN_VOLTAGE:
+			Convert::fanVoltage((const u_int16_t*) values, out, count);
+			return;
+		case CONVERT_VOLTAGE:
+			Convert::voltage((const u_int16_t*) values, out, count);
+			return;
+		default:
+			for (size_t i = 0; i < count; i++) {
+				u_int32_t raw = 0;
+				memcpy(&raw, values + i * field->size, field->size);
+				out[i] = field->convert(raw, NULL, settings);
+			}
+	}
+}
+
+History::History(size_t capacity) {
+
+	this->capacity = capacity > 0 ? capacity : 1;
+	this->count = 0;
+	this->head = 0;
+
+	size_t count;
+	const SchemaField *table = Schema::fields(IO::DATA_REPORT, &count);
+
+	for (size_t i = 0; i < count; i++) {
+		if (storable(&table[i]))
+			fields.push_back(&table[i]);
+	}
+
+	timestamps = NULL;
+	columns = NULL;
+};
+
+/**
+ * Allocates a history for capacity samples
+ * @param size_t capacity At most MAX_CAPACITY
+ * @return History* NULL if the memory isn't available
+ */
+History *History::create(size_t capacity) {
+
+	History *history = new History(capacity);
+
+	history->timestamps = (uint64_t*) malloc(history->capacity * sizeof(uint64_t));
+	history->columns = (unsigned char**) calloc(history->fields.size(), sizeof(unsigned char*));
+
+	if (!history->timestamps || !history->columns) {
+		delete history;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < history->fields.size(); i++) {
+
+		history->columns[i] = (unsigned char*) malloc(history->capacity * history->fields[i]->size);
+
+		if (!history->columns[i]) {
+			delete history;
+			return NULL;
+		}
+	}
+
+	return history;
+};
+
+History::~History() {
+
+	for (size_t i = 0; columns && i < fields.size(); i++)
+		free(columns[i]);
+
+	free(columns);
+	free(timestamps);
+};
+
+/**
+ * Appends a sample, one older than the last is dropped: sampler batches
+ * are handed over late and may arrive after a newer getReport(4)
+ * @param uint64_t timestamp CLOCK_MONOTONIC in ns
+ * @param const IO::pumpDataReport *report
+ */
+void History::append(uint64_t timestamp, const IO::pumpDataReport *report) {
+
+	// lowerBound() needs ascending timestamps
+	if (count && timestamp < last())
+		return;
+
+	const unsigned char *data = (const unsigned char*) report;
+
+	timestamps[head] = timestamp;
+
+	// raw values are stored little endian in the width of the member,
+	// bitfields in a byte
+	for (size_t i = 0; i < fields.size(); i++) {
+		u_int32_t raw = fields[i]->raw(data, 0);
+		memcpy(columns[i] + head * fields[i]->size, &raw, fields[i]->size);
+	}
+
+	head = (head + 1) % capacity;
+
+	if (count < capacity)
+		count++;
+};
+
+size_t History::size() const {
+	return count;
+};
+
+uint64_t History::first() const {
+	return count ? timestamps[index(0)] : 0;
+};
+
+uint64_t History::last() const {
+	return count ? timestamps[index(count - 1)] : 0;
+};
+
+/**
+ * Maps a position (0 = oldest sample) to the storage index
+ */
+size_t History::index(size_t position) const {
+	return (head + capacity - count + position) % capacity;
+};
+
+/**
+ * Position of the first sample at or after timestamp
+ */
+size_t History::lowerBound(uint64_t timestamp) const {
+
+	size_t low = 0, high = count;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (timestamps[index(middle)] < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+};
+
+/**
+ * Returns the aggregation for "min", "max", "mean" or "last", -1 if unknown
+ * @param const char *name
+ * @return int
+ */
+int History::aggregateType(const char *name) {
+
+	if (!strcmp(name, "min"))
+		return AGGREGATE_MIN;
+	if (!strcmp(name, "max"))
+		return AGGREGATE_MAX;
+	if (!strcmp(name, "mean"))
+		return AGGREGATE_MEAN;
+	if (!strcmp(name, "last"))
+		return AGGREGATE_LAST;
+
+	return -1;
+};
+
+/**
+ * Downsamples [from, to) into buckets of step ns
+ *
+ * Returns { timestamp: Float64Array, <field>: Float64Array, ... } with the
+ * bucket start in ms and one aggregated value per bucket, NaN for buckets
+ * without samples.
+ *
+ * Fan rpm are converted with settings for every sample, so older samples
+ * are rescaled after measureFanEdges changed.
+ *
+ * @param uint64_t from
+ * @param uint64_t to
+ * @param uint64_t step
+ * @param int aggregate
+ * @param const IO::pumpSettingsReport *settings
+ * @return Local<Object>
+ */
+Handle<Object> History::query(
+	uint64_t from,
+	uint64_t to,
+	uint64_t step,
+	int aggregate,
+	const IO::pumpSettingsReport *settings
+) {
+
+	HandleScope scope;
+	Local<Object> result = Object::New();
+
+	if (step == 0 || to <= from) {
+		ThrowException(Exception::RangeError(String::New("Invalid time range")));
+		return scope.Close(result);
+	}
+
+	size_t buckets = (to - from + step - 1) / step;
+
+	if (buckets > MAX_BUCKETS) {
+		ThrowException(Exception::RangeError(String::New("Too many buckets")));
+		return scope.Close(result);
+	}
+
+	size_t start = lowerBound(from);
+	size_t end = lowerBound(to);
+
+	// bucket of every sample in range, buckets = outside
+	std::vector<size_t> bucket(end - start);
+
+	for (size_t position = start; position < end; position++) {
+
+		uint64_t time = timestamps[index(position)];
+
+		bucket[position - start] = time >= from && time < to ? (time - from) / step : buckets;
+	}
+
+	double *data;
+	Local<Object> timestamp = TypedArray::New("Float64Array", buckets, (void**) &data);
+
+	if (timestamp.IsEmpty())
+		return scope.Close(result);
+
+	for (size_t i = 0; i < buckets; i++)
+		data[i] = (from + i * step) / 1e6;
+
+	result->Set(String::NewSymbol("timestamp"), timestamp);
+
+	std::vector<uint32_t> samples(buckets);
+	std::vector<double> converted(end - start);
+
+	// the range is at most two runs of the ring buffer
+	size_t first = index(start);
+	size_t run = std::min(end - start, capacity - first);
+
+	for (size_t c = 0; c < fields.size(); c++) {
+
+		const SchemaField *field = fields[c];
+		Local<Object> values = TypedArray::New("Float64Array", buckets, (void**) &data);
+
+		for (size_t i = 0; i < buckets; i++) {
+			data[i] = aggregate == AGGREGATE_MEAN ? 0 : NAN;
+			samples[i] = 0;
+		}
+
+		if (run > 0)
+			convertSpan(field, columns[c] + first * field->size, run, settings, &converted[0]);
+
+		if (run < end - start)
+			convertSpan(field, columns[c], end - start - run, settings, &converted[run]);
+
+		for (size_t position = start; position < end; position++) {
+
+			size_t b = bucket[position - start];
+			double value = converted[position - start];
+
+			if (b >= buckets)
+				continue;
+
+			switch(aggregate) {
+				case AGGREGATE_MIN:
+					if (!samples[b] || value < data[b])
+						data[b] = value;
+				break;
+				case AGGREGATE_MAX:
+					if (!samples[b] || value > data[b])
+						data[b] = value;
+				break;
+				case AGGREGATE_MEAN:
+					data[b] += value;
+				break;
+				default:
+					data[b] = value;
+				break;
+			}
+
+			samples[b]++;
+		}
+
+		if (aggregate == AGGREGATE_MEAN) {
+			for (size_t i = 0; i < buckets; i++)
+				data[i] = samples[i] ? data[i] / samples[i] : NAN;
+		}
+
+		result->Set(String::NewSymbol(field->path), values);
+	}
+
+	return scope.Close(result);
+};
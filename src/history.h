@@ -0,0 +1,74 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <v8.h>
+#include <stdint.h>
+#include <vector>
+
+#include "io.h"
+#include "schema.h"
+
+/**
+ * In-memory time series of data reports
+ *
+ * Stored as one column per field of the data schema in its raw width,
+ * values are only converted when queried, fan rpm with the settings passed
+ * to query(). The oldest samples are overwritten once the capacity is
+ * reached.
+ */
+class History {
+
+	public:
+
+		static const int AGGREGATE_MIN = 0;
+		static const int AGGREGATE_MAX = 1;
+		static const int AGGREGATE_MEAN = 2;
+		static const int AGGREGATE_LAST = 3;
+
+		// a month at 1 Hz, about 60 bytes per sample
+		static const uint32_t MAX_CAPACITY = 31 * 86400;
+
+		static History *create(size_t capacity);
+		~History();
+
+		void append(uint64_t timestamp, const IO::pumpDataReport *report);
+
+		v8::Handle<v8::Object> query(
+			uint64_t from,
+			uint64_t to,
+			uint64_t step,
+			int aggregate,
+			const IO::pumpSettingsReport *settings
+		);
+
+		size_t size() const;
+		uint64_t first() const;
+		uint64_t last() const;
+
+		static int aggregateType(const char *name);
+
+	private:
+
+		History(size_t capacity);
+
+		size_t index(size_t position) const;
+		size_t lowerBound(uint64_t timestamp) const;
+
+		size_t capacity;
+		size_t count;
+		size_t head;
+
+		uint64_t *timestamps;
+		unsigned char **columns;
+
+		// schema field of each column
+		std::vector<const SchemaField*> fields;
+
+};
+
+#endif
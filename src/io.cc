@@ -12,14 +12,38 @@
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <limits.h>
+#include <algorithm>
+#include <map>
 
 #include "io.h"
 #include "convert.h"
+#include "stats.h"
+#include "schema.h"
 
 using namespace v8;
 
+// in-class constants may be bound to references
+const int IO::DATA_REPORT;
+const int IO::SETTINGS_REPORT;
+
+// hiddev device nodes, depending on the distribution
+static const char *devicePaths[] = {
+	"/dev/usb/hiddev%d",
+	"/dev/usb/hid/hiddev%d",
+	"/dev/hiddev%d",
+	NULL
+};
+
+// matching device nodes by vendor / product id, see IO::openDevice
+static std::map<std::pair<int, int>, std::vector<std::string> > deviceCache;
+
 /**
  * Checks if provided handle is an Aquastream XT pump
  *
@@ -29,7 +53,8 @@ int IO::isAquastreamXt(int handle, int vendorId, int productId) {
 
 	struct hiddev_devinfo deviceInfo;
 
-	ioctl(handle, HIDIOCGDEVINFO, &deviceInfo);
+	if (ioctl(handle, HIDIOCGDEVINFO, &deviceInfo) < 0)
+		return 0;
 
 	return (
 		(deviceInfo.vendor == vendorId) &&
@@ -39,22 +64,97 @@ int IO::isAquastreamXt(int handle, int vendorId, int productId) {
 };
 
 /**
- * Returns the correct handle (file descriptor) on success
+ * Reads a hex id (idVendor, idProduct) from sysfs
+ * @param const char *path
+ * @return int -1 on error
+ */
+static int readSysfsId(const char *path) {
+
+	char value[16];
+	FILE *file = fopen(path, "r");
+
+	if (!file)
+		return -1;
+
+	int ret = fgets(value, sizeof(value), file) ? (int) strtol(value, NULL, 16) : -1;
+
+	fclose(file);
+
+	return ret;
+}
+
+/**
+ * Lists the device nodes of all matching hiddev devices
+ *
+ * Vendor and product ids are read from /sys/class/usbmisc, so only the
+ * matching nodes are touched.
  *
  * @param int vendorId
  * @param int productId
- * @return int
+ * @param std::vector<std::string> *paths
+ * @return int Number of devices found, -1 if sysfs isn't available
  */
-int IO::openDevice(int vendorId, int productId) {
+int IO::findDevices(int vendorId, int productId, std::vector<std::string> *paths) {
 
-	char devicePath[24];
+	DIR *dir = opendir("/sys/class/usbmisc");
 
-	const char *devicePaths[] = {
-		"/dev/usb/hiddev\%d",
-		"/dev/usb/hid/hiddev\%d",
-		"/dev/hiddev\%d",
-		NULL
-	};
+	if (!dir)
+		return -1;
+
+	std::vector<int> minors;
+	struct dirent *entry;
+	char path[PATH_MAX];
+
+	while ((entry = readdir(dir))) {
+
+		if (strncmp(entry->d_name, "hiddev", 6))
+			continue;
+
+		// the device link points to the USB interface
+		snprintf(path, sizeof(path), "/sys/class/usbmisc/%s/device/../idVendor", entry->d_name);
+
+		if (readSysfsId(path) != vendorId)
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/class/usbmisc/%s/device/../idProduct", entry->d_name);
+
+		if (readSysfsId(path) != productId)
+			continue;
+
+		minors.push_back(atoi(entry->d_name + 6));
+	}
+
+	closedir(dir);
+
+	std::sort(minors.begin(), minors.end());
+
+	for (size_t i = 0; i < minors.size(); i++) {
+		for (int j = 0; devicePaths[j]; j++) {
+
+			snprintf(path, sizeof(path), devicePaths[j], minors[i]);
+
+			if (access(path, F_OK) == 0) {
+				paths->push_back(path);
+				break;
+			}
+		}
+	}
+
+	return paths->size();
+};
+
+/**
+ * Lists the device nodes of all matching hiddev devices by opening every
+ * node, used if sysfs isn't available
+ *
+ * @param int vendorId
+ * @param int productId
+ * @param std::vector<std::string> *paths
+ * @return int Number of devices found
+ */
+int IO::scanDevices(int vendorId, int productId, std::vector<std::string> *paths) {
+
+	char devicePath[PATH_MAX];
 
 	unsigned int numIterations = 15, i, j;
 	int handle;
@@ -63,49 +163,178 @@ int IO::openDevice(int vendorId, int productId) {
 
 		for (j = 0; j < numIterations; j++) {
 
-			sprintf(devicePath, devicePaths[i], j);
+			snprintf(devicePath, sizeof(devicePath), devicePaths[i], j);
 
 			if((handle = open(devicePath, O_RDONLY)) >= 0) {
 
 				if(isAquastreamXt(handle, vendorId, productId))
-					return handle;
+					paths->push_back(devicePath);
 
 				close(handle);
 			}
 		}
 	};
 
-	ThrowException(Exception::Error(String::New("Couldn't find Aquastream XT!")));
-	return 0;
+	return paths->size();
+};
+
+/**
+ * Lists the device nodes of all matching devices
+ *
+ * @param int vendorId
+ * @param int productId
+ * @param std::vector<std::string> *paths
+ * @return int Number of devices found
+ */
+int IO::enumerate(int vendorId, int productId, std::vector<std::string> *paths) {
+
+	if (findDevices(vendorId, productId, paths) >= 0)
+		return paths->size();
+
+	return scanDevices(vendorId, productId, paths);
+};
+
+/**
+ * Opens a device node if it's a matching device
+ *
+ * @param const char *devicePath
+ * @param int vendorId
+ * @param int productId
+ * @return int handle, -1 otherwise
+ */
+int IO::openPath(const char *devicePath, int vendorId, int productId) {
+
+	int handle = open(devicePath, O_RDONLY);
+
+	if (handle < 0)
+		return -1;
+
+	if (!isAquastreamXt(handle, vendorId, productId)) {
+		close(handle);
+		return -1;
+	}
+
+	return handle;
+};
+
+/**
+ * Returns the correct handle (file descriptor) on success, -1 otherwise
+ *
+ * The matching device nodes are cached, so reopening doesn't search again
+ * unless the devices have moved.
+ *
+ * @param int vendorId
+ * @param int productId
+ * @return int
+ */
+int IO::openDevice(int vendorId, int productId) {
+
+	std::vector<std::string> &paths = deviceCache[std::make_pair(vendorId, productId)];
+	int handle;
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+
+		for (size_t i = 0; i < paths.size(); i++) {
+			if ((handle = openPath(paths[i].c_str(), vendorId, productId)) >= 0)
+				return handle;
+		}
+
+		paths.clear();
+		enumerate(vendorId, productId, &paths);
+	}
+
+	return -1;
+};
+
+/**
+ * Issues an ioctl and records its latency
+ * @param int handle
+ * @param unsigned long request
+ * @param void *arg
+ * @param int metric Stats::IOCTL_*
+ * @return int
+ */
+static int timedIoctl(int handle, unsigned long request, void *arg, int metric) {
+
+	uint64_t start = Stats::now();
+	int ret = ioctl(handle, request, arg);
+
+	Stats::record(metric, start, ret < 0);
+
+	return ret;
+}
+
+/**
+ * Returns the length of a feature report, HID_REPORT_TYPE_FEATURE field 0
+ * has a usage per byte plus the report id. The length doesn't change while
+ * the device is open, so it may be cached.
+ *
+ * @param int handle
+ * @param int reportId
+ * @return int reportLength or one of the ERROR_* codes
+ */
+int IO::getReportLength(int handle, int reportId) {
+
+	struct hiddev_field_info fieldInfo;
+
+	fieldInfo.report_type   = HID_REPORT_TYPE_FEATURE;
+	fieldInfo.report_id     = reportId;
+	fieldInfo.field_index   = 0;
+
+	if (timedIoctl(handle, HIDIOCGFIELDINFO, &fieldInfo, Stats::IOCTL_GET_FIELD_INFO) < 0)
+		return ERROR_GET_FIELD_INFO;
+
+	if ((int) fieldInfo.maxusage > REPORT_LENGTH)
+		return ERROR_REPORT_TOO_LARGE;
+
+	return fieldInfo.maxusage;
 };
 
 /**
  * Gets a HID feature report
+ * Doesn't touch V8, so it may be called from a worker thread.
+ *
  * @param int handle The device handle
  * @param int reportId The requested Report number
  * @param unsigned char *buffer
+ * @param size_t length Size of buffer
+ * @return int reportLength or one of the ERROR_* codes
  */
 int IO::getFeatureReport(
 	int handle,
 	int reportId,
-	unsigned char *buffer
+	unsigned char *buffer,
+	size_t length
 ) {
 
-	struct hiddev_report_info       reportInfo;
-	struct hiddev_field_info        fieldInfo;
-	struct hiddev_usage_ref_multi   usageRef;
+	int reportLength = getReportLength(handle, reportId);
 
-	fieldInfo.report_type           = HID_REPORT_TYPE_FEATURE;
-	fieldInfo.report_id             = reportId;
-	fieldInfo.field_index           = 0;
+	if (reportLength < 0)
+		return reportLength;
 
-	int ret = ioctl(handle, HIDIOCGFIELDINFO, &fieldInfo);
-	int reportLength = fieldInfo.maxusage;
+	return getFeatureReport(handle, reportId, reportLength, buffer, length);
+};
 
-	if (reportLength > REPORT_LENGTH) {
-		ThrowException(Exception::TypeError(String::New("Invalid Report: too large")));
-		return 0;
-	}
+/**
+ * Gets a HID feature report of known length, see getReportLength()
+ *
+ * @param int handle
+ * @param int reportId
+ * @param int reportLength
+ * @param unsigned char *buffer
+ * @param size_t length Size of buffer
+ * @return int reportLength or one of the ERROR_* codes
+ */
+int IO::getFeatureReport(
+	int handle,
+	int reportId,
+	int reportLength,
+	unsigned char *buffer,
+	size_t length
+) {
+
+	struct hiddev_report_info       reportInfo;
+	struct hiddev_usage_ref_multi   usageRef;
 
 	reportInfo.report_type  = HID_REPORT_TYPE_FEATURE;
 	reportInfo.report_id    = reportId;
@@ -118,24 +347,20 @@ int IO::getFeatureReport(
 	usageRef.num_values         = reportLength;
 
 	// get info report
-	ret = ioctl(handle, HIDIOCGREPORT, &reportInfo);
+	int ret = timedIoctl(handle, HIDIOCGREPORT, &reportInfo, Stats::IOCTL_GET_REPORT);
 
-	if (ret != 0) {
-		ThrowException(Exception::Error(String::New("HIDIOCGREPORT error")));
-		return 0;
-	}
+	if (ret != 0)
+		return ERROR_GET_REPORT;
 
 	// get usage report
-	ret = ioctl(handle, HIDIOCGUSAGES, &usageRef);
+	ret = timedIoctl(handle, HIDIOCGUSAGES, &usageRef, Stats::IOCTL_GET_USAGES);
 
-	if (ret != 0) {
-		ThrowException(Exception::Error(String::New("HIDIOCGUSAGES error")));
-		return 0;
-	}
+	if (ret != 0)
+		return ERROR_GET_USAGES;
 
 	// transfer to local buffer
 	int i;
-	for (i = 0; i < reportLength - 1; i++)
+	for (i = 0; i < reportLength - 1 && i < (int)length; i++)
 		buffer[i] = usageRef.values[i];
 
 	return reportLength;
@@ -143,32 +368,49 @@ int IO::getFeatureReport(
 
 /**
  * Sets a feature report
+ * Doesn't touch V8, so it may be called from a worker thread.
+ *
  * @param int handle
  * @param int reportId
- * @param unsigned char *buffer
- * @return int reportLength
+ * @param const unsigned char *buffer
+ * @param size_t length Size of buffer, the rest of the report is zeroed
+ * @return int reportLength or one of the ERROR_* codes
  */
 int IO::setFeatureReport(
 	int handle,
 	int reportId,
-	unsigned char *buffer
+	const unsigned char *buffer,
+	size_t length
 ) {
 
-	struct hiddev_report_info       reportInfo;
-	struct hiddev_field_info        fieldInfo;
-	struct hiddev_usage_ref_multi   usageRef;
+	int reportLength = getReportLength(handle, reportId);
 
-	fieldInfo.report_type   = HID_REPORT_TYPE_FEATURE;
-	fieldInfo.report_id     = reportId;
-	fieldInfo.field_index   = 0;
+	if (reportLength < 0)
+		return reportLength;
 
-	int ret 		 = ioctl(handle, HIDIOCGFIELDINFO, &fieldInfo);
-	int reportLength = fieldInfo.maxusage;
+	return setFeatureReport(handle, reportId, reportLength, buffer, length);
+};
 
-	if (reportLength > REPORT_LENGTH) {
-		ThrowException(Exception::Error(String::New("Received report too large")));
-		return 0;
-	}
+/**
+ * Sets a feature report of known length, see getReportLength()
+ *
+ * @param int handle
+ * @param int reportId
+ * @param int reportLength
+ * @param const unsigned char *buffer
+ * @param size_t length Size of buffer, the rest of the report is zeroed
+ * @return int reportLength or one of the ERROR_* codes
+ */
+int IO::setFeatureReport(
+	int handle,
+	int reportId,
+	int reportLength,
+	const unsigned char *buffer,
+	size_t length
+) {
+
+	struct hiddev_report_info       reportInfo;
+	struct hiddev_usage_ref_multi   usageRef;
 
 	reportInfo.report_type  = HID_REPORT_TYPE_FEATURE;
 	reportInfo.report_id    = reportId;
@@ -185,414 +427,234 @@ int IO::setFeatureReport(
 	// can't use memcpy, because values are signed int32
 	int i;
 	for(i = 0; i < reportLength-1; i++)
-		usageRef.values[i] = buffer[i];
+		usageRef.values[i] = i < (int)length ? buffer[i] : 0;
 
 	// multibyte transfer to device
-	ret = ioctl(handle, HIDIOCSUSAGES, &usageRef);
+	int ret = timedIoctl(handle, HIDIOCSUSAGES, &usageRef, Stats::IOCTL_SET_USAGES);
 
-	if (ret != 0) {
-		ThrowException(Exception::Error(String::New("HIDIOCSUSAGE error")));
-		return 0;
-	}
+	if (ret != 0)
+		return ERROR_SET_USAGES;
 
 	// write report to device
-    ret = ioctl(handle, HIDIOCSREPORT, &reportInfo);
+    ret = timedIoctl(handle, HIDIOCSREPORT, &reportInfo, Stats::IOCTL_SET_REPORT);
 
-	if (ret != 0) {
-		ThrowException(Exception::Error(String::New("HIDIOCSREPORT error")));
-		return 0;
-	}
+	if (ret != 0)
+		return ERROR_SET_REPORT;
 
 	return reportLength;
 };
 
 /**
- * Returns a Node readable object of the pumpDataReport struct
- * @param Local<Value> handle
- * @param Local<Value> reportId
- * @param Handle<Object> settings
- * @return Local<Object> data
+ * Resolves the path of an open device handle
+ * @param int handle
+ * @param char *devicePath
+ * @param size_t length Size of devicePath
+ * @return int length of the path, -1 on error
  */
-Handle<Object> IO::getData(Local<Value> handle, Local<Value> reportId, Handle<Object> settings) {
-
-	HandleScope scope;
+int IO::getDevicePath(int handle, char *devicePath, size_t length) {
 
-	unsigned char *buffer           = (unsigned char*) malloc(REPORT_LENGTH);
-	struct pumpDataReport *report   = (struct pumpDataReport*) buffer;
+	char procPath[32];
 
-	int bytes;
+	snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", handle);
 
-	Local<Object> data = Object::New();
+	ssize_t len = readlink(procPath, devicePath, length - 1);
 
-	bytes = getFeatureReport(handle->NumberValue(), reportId->NumberValue(), buffer);
-
-	if(bytes <= 0)	{
-		free(buffer);
-		ThrowException(Exception::Error(String::New("Couldn't get data report")));
-		return data;
+	if (len < 0) {
+		devicePath[0] = '\0';
+		return -1;
 	}
 
-	// Controller data
-	Local<Object> controller = Object::New();
-
-		controller->Set(String::NewSymbol("i"), Number::New(Convert::controllerOutScale(report->controllerI)));
-		controller->Set(String::NewSymbol("p"), Number::New(Convert::controllerOutScale(report->controllerP)));
-		controller->Set(String::NewSymbol("d"), Number::New(Convert::controllerOutScale(report->controllerD)));
-		controller->Set(String::NewSymbol("output"), Number::New(Convert::controllerOutScale(report->controllerOut)));
-
-		data->Set(String::NewSymbol("controller"), Local<Object>::New(controller));
-
-	// Current values
-	Local<Object> current = Object::New();
-
-		current->Set(String::NewSymbol("flow"), Number::New(report->flow));
-
-		current->Set(String::NewSymbol("frequency"), Integer::New(Convert::frequency(report->frequency)));
-
-		current->Set(String::NewSymbol("frequencyMax"), Integer::New(
-			Convert::fanRpm(
-				report->frequencyMax,
-				settings->Get(String::NewSymbol("measureFanEdges"))->NumberValue()
-			)
-		));
-
-		current->Set(String::NewSymbol("fanVoltageMeasured"), Number::New(Convert::fanVoltage(report->rawSensorData[3])));
-		current->Set(String::NewSymbol("fanVoltage"), Number::New(
-			Convert::voltage(report->rawSensorData[4]) * (Convert::scalePercent(report->fanPower) / 100)
-		));
-		current->Set(String::NewSymbol("voltage"), Number::New(Convert::voltage(report->rawSensorData[4])));
-		current->Set(String::NewSymbol("pumpCurrent"), Number::New(Convert::current(report->rawSensorData[5])));
-		current->Set(String::NewSymbol("pumpPower"), Number::New(
-			(Convert::current(report->rawSensorData[5]) * Convert::voltage(report->rawSensorData[4])) / 1000
-		));
-
-		current->Set(String::NewSymbol("fanRpm"), Number::New(
-			Convert::fanRpm(
-				report->fanRpm,
-				settings->Get(String::NewSymbol("measureFanEdges"))->NumberValue()
-			)
-		));
+	devicePath[len] = '\0';
 
-		// Temperature data
-		Local<Object> temperature = Object::New();
+	return len;
+};
 
-			temperature->Set(String::NewSymbol("pump"), Number::New(Convert::temperature(report->temperatureRaw[0])));
-			temperature->Set(String::NewSymbol("external"), Number::New(Convert::temperature(report->temperatureRaw[1])));
-			temperature->Set(String::NewSymbol("water"), Number::New(Convert::temperature(report->temperatureRaw[2])));
+/**
+ * Returns a readable message for the ERROR_* codes
+ * @param int error
+ * @return const char*
+ */
+const char *IO::errorString(int error) {
+
+	switch(error) {
+		case ERROR_REPORT_TOO_LARGE:
+			return "Invalid Report: too large";
+		case ERROR_GET_REPORT:
+			return "HIDIOCGREPORT error";
+		case ERROR_GET_USAGES:
+			return "HIDIOCGUSAGES error";
+		case ERROR_SET_USAGES:
+			return "HIDIOCSUSAGE error";
+		case ERROR_SET_REPORT:
+			return "HIDIOCSREPORT error";
+		case ERROR_GET_FIELD_INFO:
+			return "HIDIOCGFIELDINFO error";
+	}
 
-			current->Set(String::NewSymbol("temperature"), Local<Object>::New(temperature));
+	return "Unknown error";
+};
 
-			data->Set(String::NewSymbol("current"), Local<Object>::New(current));
+// key of getDeviceInfo(), report keys are interned by the schema
+static Persistent<String> devicePathKey;
 
-	// Alarm data
-	Local<Object> alarm = Object::New();
+// "00" - "FF" for the public key
+static Persistent<String> hexBytes[256];
 
-		alarm->Set(String::NewSymbol("sensor0"), Number::New(report->alarmSensor0));
-		alarm->Set(String::NewSymbol("sensor1"), Number::New(report->alarmSensor1));
-		alarm->Set(String::NewSymbol("fan"), Number::New(report->alarmFan));
-		alarm->Set(String::NewSymbol("flow"), Number::New(report->alarmFlow));
+/**
+ * Creates the property keys and the report schema, call once from the
+ * module initializer
+ */
+void IO::Init() {
 
-		data->Set(String::NewSymbol("alarm"), Local<Object>::New(alarm));
+	HandleScope scope;
 
-	// Pump Mode information
-	Local<Object> mode = Object::New();
+	devicePathKey = Persistent<String>::New(String::NewSymbol("devicePath"));
 
-		mode->Set(String::NewSymbol("advancedPumpSettings"), Number::New(report->modeAdvancedPumpSettings));
-		mode->Set(String::NewSymbol("aquastreamModeAdvanced"), Number::New(report->modeAquastreamModeAdvanced));
-		mode->Set(String::NewSymbol("aquastreamModeUltra"), Number::New(report->modeAquastreamModeUltra));
+	char hex[3];
 
-		data->Set(String::NewSymbol("mode"), Local<Object>::New(mode));
+	for (int i = 0; i < 256; i++) {
+		snprintf(hex, sizeof(hex), "%02X", i);
+		hexBytes[i] = Persistent<String>::New(String::NewSymbol(hex));
+	}
 
-	// Pump Hardware information
-	Local<Object> hardware = Object::New();
+	Schema::Init();
+}
 
-		hardware->Set(String::NewSymbol("firmware"), Number::New(report->firmware));
-		hardware->Set(String::NewSymbol("bootloader"), Number::New(report->bootloader));
-		hardware->Set(String::NewSymbol("hardware"), Number::New(report->hardware));
-		hardware->Set(String::NewSymbol("serial"), Number::New(report->serial));
+/**
+ * Returns a byte as two digit hex string, interned by Init()
+ * @param unsigned char value
+ * @return Handle<String>
+ */
+Handle<String> IO::hexByte(unsigned char value) {
+	return hexBytes[value];
+}
 
-		char tmpKey[4];
-		Local<Array> publicKey = Array::New();
-		for (int i = 0; i < 6; i++) {
-			sprintf(tmpKey, "%02X", report->publicKey[ i ]);
-			publicKey->Set(Number::New(i), String::New(tmpKey));
-		}
+/**
+ * Returns a Node readable object of the pumpDataReport struct
+ * @param const pumpDataReport *report
+ * @param const pumpSettingsReport *settings
+ * @return Local<Object> data
+ */
+Handle<Object> IO::getData(const pumpDataReport *report, const pumpSettingsReport *settings) {
 
-		hardware->Set(String::NewSymbol("publicKey"), Local<Array>::New(publicKey));
+	HandleScope scope;
+	uint64_t start = Stats::now();
 
-		data->Set(String::NewSymbol("hardware"), Local<Object>::New(hardware));
+	Handle<Object> data = Schema::decode(DATA_REPORT, (const unsigned char*) report, settings);
 
-	free(buffer);
+	Stats::record(Stats::GET_DATA, start, false);
 
-	return data;
+	return scope.Close(data);
 }
 
 /**
  * Returns a settings object
- * @param Local<Value> handle
- * @param Local<Value> reportId
+ * @param const pumpSettingsReport *report
  * @return Local<Object> settings
  */
-Handle<Object> IO::getSettings(Local<Value> handle, Local<Value> reportId) {
+Handle<Object> IO::getSettings(const pumpSettingsReport *report) {
 
 	HandleScope scope;
+	uint64_t start = Stats::now();
 
-	unsigned char *buffer               = (unsigned char*) malloc(REPORT_LENGTH);
-	struct pumpSettingsReport *report   = (struct pumpSettingsReport*) buffer;
-
-	int bytes;
-
-	bytes = getFeatureReport(handle->NumberValue(), reportId->NumberValue(), buffer);
-
-	Local<Object> settings = Object::New();
-
-	if(bytes <= 0)	{
-		free(buffer);
-		ThrowException(Exception::Error(String::New("Couldn't get settings report")));
-		return settings;
-	}
-
-	// Pump Hardware information
-	Local<Object> pumpMode = Object::New();
-
-		pumpMode->Set(String::NewSymbol("deaeration"), Number::New(report->pumpMode_deaeration));
-		pumpMode->Set(String::NewSymbol("autoPumpMaxFrequency"), Number::New(report->pumpMode_autoPumpMaxFreq));
-		pumpMode->Set(String::NewSymbol("deaerationModeSensor"), Number::New(report->pumpMode_deaerationModeSens));
-		pumpMode->Set(String::NewSymbol("resetPumpMaxFrequency"), Number::New(report->pumpMode_resetPumpMaxFreq));
-		pumpMode->Set(String::NewSymbol("i2cControl"), Number::New(report->pumpMode_i2cControl));
-		pumpMode->Set(String::NewSymbol("minFrequencyForce"), Number::New(report->pumpMode_minFreqForce));
-		pumpMode->Set(String::NewSymbol("pumpModeB"), Number::New(report->pumpModeB));
-
-		settings->Set(String::NewSymbol("pumpMode"), Local<Object>::New(pumpMode));
-
-	// i2c settings
-	Local<Object> i2c = Object::New();
-
-		i2c->Set(String::NewSymbol("address"), Number::New(report->i2cAddress));
-		i2c->Set(String::NewSymbol("settingAquabusEnable"), Number::New(report->i2cSetting_aquabusEnable));
-
-		settings->Set(String::NewSymbol("i2c"), Local<Object>::New(i2c));
-
-	settings->Set(String::NewSymbol("sensorBridge"), Number::New(report->sensorBridge));
-	settings->Set(String::NewSymbol("measureFanEdges"), Number::New(report->measureFanEdges));
-	settings->Set(String::NewSymbol("measureFlowEdges"), Number::New(report->measureFlowEdges));
-
-	// Pump frequency information
-	Local<Object> frequency = Object::New();
-
-		Local<Object> pumpFrequency = Object::New();
-
-			pumpFrequency->Set(String::NewSymbol("current"), Integer::New(Convert::frequency(report->pumpFrequency)));
-			pumpFrequency->Set(String::NewSymbol("min"), Integer::New(Convert::frequency(report->minPumpFrequency)));
-			pumpFrequency->Set(String::NewSymbol("max"), Integer::New(Convert::frequency(report->maxPumpFrequency)));
-
-		frequency->Set(String::NewSymbol("pump"), Local<Object>::New(pumpFrequency));
-		frequency->Set(String::NewSymbol("resetCycle"), Number::New(Convert::frequencyResetCycle(report->frequencyResetCycle)));
-
-		settings->Set(String::NewSymbol("frequency"), Local<Object>::New(frequency));
+	Handle<Object> settings = Schema::decode(SETTINGS_REPORT, (const unsigned char*) report, report);
 
-	// Alarm information
-	Local<Object> alarm = Object::New();
-
-		alarm->Set(String::NewSymbol("sensor0"), Number::New(report->alarm_sensor0));
-		alarm->Set(String::NewSymbol("sensor1"), Number::New(report->alarm_sensor1));
-
-		alarm->Set(String::NewSymbol("pump"), Number::New(report->alarm_pump));
-		alarm->Set(String::NewSymbol("fan"), Number::New(report->alarm_fan));
-		alarm->Set(String::NewSymbol("flow"), Number::New(report->alarm_flow));
-		alarm->Set(String::NewSymbol("fanShort"), Number::New(report->alarm_fanShort));
-		alarm->Set(String::NewSymbol("fanOverTemp70"), Number::New(report->alarm_fanOverTemp70));
-		alarm->Set(String::NewSymbol("fanOverTemp90"), Number::New(report->alarm_fanOverTemp90));
-
-		settings->Set(String::NewSymbol("alarm"), Local<Object>::New(alarm));
-
-	// Tacho information
-	Local<Object> tacho = Object::New();
-
-		Local<Object> tachoMode = Object::New();
-
-			tachoMode->Set(String::NewSymbol("linkFan"), Number::New(report->tachoMode_linkFan));
-			tachoMode->Set(String::NewSymbol("linkFlow"), Number::New(report->tachoMode_linkFlow));
-			tachoMode->Set(String::NewSymbol("linkPump"), Number::New(report->tachoMode_linkPump));
-			tachoMode->Set(String::NewSymbol("linkStatic"), Number::New(report->tachoMode_linkStatic));
-			tachoMode->Set(String::NewSymbol("linkAlarmInterrupt"), Number::New(report->tachoMode_linkAlarmInterrupt));
-			tachoMode->Set(String::NewSymbol("linkFan"), Number::New(report->tachoMode_linkFan));
-
-			tacho->Set(String::NewSymbol("mode"), Local<Object>::New(tachoMode));
-
-		tacho->Set(String::NewSymbol("frequency"), Number::New(Convert::staticTachoRpm(report->tachoFrequency)));
-		tacho->Set(String::NewSymbol("flowAlarmValue"), Number::New(report->flowAlarmValue));
-
-		settings->Set(String::NewSymbol("tacho"), Local<Object>::New(tacho));
-
-	//settings->sensorAlarmTemperature[2];
-	Local<Object> fanMode = Object::New();
-
-		fanMode->Set(String::NewSymbol("manual"), Number::New(report->fanMode_manual));
-		fanMode->Set(String::NewSymbol("auto"), Number::New(report->fanMode_auto));
-		fanMode->Set(String::NewSymbol("holdMinPower"), Number::New(report->fanMode_holdMinPower));
-
-		settings->Set(String::NewSymbol("fanMode"), Local<Object>::New(fanMode));
-
-	settings->Set(String::NewSymbol("fanManualPower"), Number::New(Convert::scalePercent(report->fanManualPower)));
-
-	Local<Object> controller = Object::New();
-
-		controller->Set(String::NewSymbol("hysterese"), Number::New(Convert::temperature(report->controllerHysterese)));
-		controller->Set(String::NewSymbol("sensor"), Number::New(report->controllerSensor));
-		controller->Set(String::NewSymbol("setTemp"), Number::New(Convert::temperature(report->controllerSetTemp)));
-		controller->Set(String::NewSymbol("P"), Number::New(report->controllerP));
-		controller->Set(String::NewSymbol("I"), Number::New(report->controllerI));
-		controller->Set(String::NewSymbol("D"), Number::New(report->controllerD));
-
-		settings->Set(String::NewSymbol("controller"), Local<Object>::New(controller));
-
-	settings->Set(String::NewSymbol("sensorMinTemperature"), Number::New(Convert::temperature(report->sensorMinTemperature)));
-	settings->Set(String::NewSymbol("sensorMaxTemperature"), Number::New(Convert::temperature(report->sensorMaxTemperature)));
-	settings->Set(String::NewSymbol("fanMinimumPower"), Number::New(report->fanMinimumPower));
-	settings->Set(String::NewSymbol("fanMaximumPower"), Number::New(report->fanMaximumPower));
-	settings->Set(String::NewSymbol("ledSettings"), Number::New(report->ledSettings));
-	settings->Set(String::NewSymbol("aquabusTimeout"), Number::New(report->aquabusTimeout));
-
-	free(buffer);
+	Stats::record(Stats::GET_SETTINGS, start, false);
 
 	return scope.Close(settings);
 }
 
 /**
- * Sets the settings
- * @param Local<Value> handle
- * @param Local<Value> reportId
+ * Fills a settings report from a possibly partial settings object
  * @param Handle<Object> settings
- * @return int
+ * @param pumpSettingsReport *report
+ * @param pumpSettingsReport *mask Bits of the values settings contains
  */
-Handle<Value> IO::setSettings(Local<Value> handle, Local<Value> reportId, Handle<Object> settings) {
-
-	HandleScope scope;
-
-	unsigned char *buffer               = (unsigned char*) malloc(REPORT_LENGTH);
-	struct pumpSettingsReport *report   = (struct pumpSettingsReport*) buffer;
-
-	// Pump Hardware information
-	Local<Object> pumpMode = settings->Get(String::NewSymbol("pumpMode"))->ToObject();
-
-		report->pumpMode_deaeration = pumpMode->Get(String::NewSymbol("deaeration"))->Uint32Value();
-		report->pumpMode_autoPumpMaxFreq = pumpMode->Get(String::NewSymbol("autoPumpMaxFrequency"))->Uint32Value();
-		report->pumpMode_deaerationModeSens = pumpMode->Get(String::NewSymbol("deaerationModeSensor"))->Uint32Value();
-		report->pumpMode_resetPumpMaxFreq = pumpMode->Get(String::NewSymbol("resetPumpMaxFrequency"))->Uint32Value();
-		report->pumpMode_i2cControl = pumpMode->Get(String::NewSymbol("i2cControl"))->Uint32Value();
-		report->pumpMode_minFreqForce = pumpMode->Get(String::NewSymbol("minFrequencyForce"))->Uint32Value();
-		report->pumpModeB = pumpMode->Get(String::NewSymbol("pumpModeB"))->Uint32Value();
-
-	// i2c settings
-	Local<Object> i2c = settings->Get(String::NewSymbol("i2c"))->ToObject();
-
-		report->i2cAddress = i2c->Get(String::NewSymbol("address"))->Uint32Value();
-		report->i2cSetting_aquabusEnable = i2c->Get(String::NewSymbol("settingAquabusEnable"))->Uint32Value();
-
-	report->sensorBridge = settings->Get(String::NewSymbol("sensorBridge"))->Uint32Value();
-	report->measureFanEdges = settings->Get(String::NewSymbol("measureFanEdges"))->Uint32Value();
-	report->measureFlowEdges = settings->Get(String::NewSymbol("measureFlowEdges"))->Uint32Value();
-
-	// Pump frequency information
-	Local<Object> frequency = settings->Get(String::NewSymbol("frequency"))->ToObject();
-
-		Local<Object> pumpFrequency = frequency->Get(String::NewSymbol("pump"))->ToObject();
-
-			report->pumpFrequency = Convert::toFrequency(pumpFrequency->Get(String::NewSymbol("current"))->Uint32Value());
-			report->minPumpFrequency = Convert::toFrequency(pumpFrequency->Get(String::NewSymbol("min"))->Uint32Value());
-			report->maxPumpFrequency = Convert::toFrequency(pumpFrequency->Get(String::NewSymbol("max"))->Uint32Value());
-
-		report->frequencyResetCycle = Convert::toFrequencyResetCycle(frequency->Get(String::NewSymbol("resetCycle"))->Uint32Value());
-
-
-	// Alarm information
-	Local<Object> alarm = settings->Get(String::NewSymbol("alarm"))->ToObject();
-
-		report->alarm_sensor0 = alarm->Get(String::NewSymbol("sensor0"))->Uint32Value();
-		report->alarm_sensor1 = alarm->Get(String::NewSymbol("sensor1"))->Uint32Value();
-
-		report->alarm_pump = alarm->Get(String::NewSymbol("pump"))->Uint32Value();
-		report->alarm_fan = alarm->Get(String::NewSymbol("fan"))->Uint32Value();
-		report->alarm_flow = alarm->Get(String::NewSymbol("flow"))->Uint32Value();
-		report->alarm_fanShort = alarm->Get(String::NewSymbol("fanShort"))->Uint32Value();
-		report->alarm_fanOverTemp70 = alarm->Get(String::NewSymbol("fanOverTemp70"))->Uint32Value();
-		report->alarm_fanOverTemp90 = alarm->Get(String::NewSymbol("fanOverTemp90"))->Uint32Value();
-
-	// Tacho information
-	Local<Object> tacho = settings->Get(String::NewSymbol("tacho"))->ToObject();
-
-		Local<Object> tachoMode = tacho->Get(String::NewSymbol("mode"))->ToObject();
-
-			report->tachoMode_linkFan = tachoMode->Get(String::NewSymbol("linkFan"))->Uint32Value();
-			report->tachoMode_linkFlow = tachoMode->Get(String::NewSymbol("linkFlow"))->Uint32Value();
-			report->tachoMode_linkPump = tachoMode->Get(String::NewSymbol("linkPump"))->Uint32Value();
-			report->tachoMode_linkStatic = tachoMode->Get(String::NewSymbol("linkStatic"))->Uint32Value();
-			report->tachoMode_linkAlarmInterrupt = tachoMode->Get(String::NewSymbol("linkAlarmInterrupt"))->Uint32Value();
-			report->tachoMode_linkFan = tachoMode->Get(String::NewSymbol("linkFan"))->Uint32Value();
-
-		report->tachoFrequency = Convert::toStaticTachoRpm(tacho->Get(String::NewSymbol("frequency"))->Uint32Value());
-		report->flowAlarmValue = tacho->Get(String::NewSymbol("flowAlarmValue"))->Uint32Value();
-
-	//settings->sensorAlarmTemperature[2];
-	Local<Object> fanMode = settings->Get(String::NewSymbol("fanMode"))->ToObject();
-
-		report->fanMode_manual = fanMode->Get(String::NewSymbol("manual"))->Uint32Value();
-		report->fanMode_auto = fanMode->Get(String::NewSymbol("auto"))->Uint32Value();
-		report->fanMode_holdMinPower = fanMode->Get(String::NewSymbol("holdMinPower"))->Uint32Value();
+void IO::setSettings(Handle<Object> settings, pumpSettingsReport *report, pumpSettingsReport *mask) {
+	Schema::encode(SETTINGS_REPORT, settings, (unsigned char*) report, (unsigned char*) mask);
+}
 
-	report->fanManualPower = Convert::toScalePercent(settings->Get(String::NewSymbol("fanManualPower"))->Uint32Value());
+/**
+ * Returns device information
+ * @param const char *devicePath
+ * @return Local<Object> info
+ */
+Handle<Object> IO::getDeviceInfo(const char *devicePath) {
 
-	Local<Object> controller = settings->Get(String::NewSymbol("controller"))->ToObject();
+	HandleScope scope;
+	Local<Object> info = Object::New();
 
-		report->controllerHysterese = Convert::toTemperature(controller->Get(String::NewSymbol("hysterese"))->Uint32Value());
-		report->controllerSensor = controller->Get(String::NewSymbol("sensor"))->Uint32Value();
-		report->controllerSetTemp = Convert::toTemperature(controller->Get(String::NewSymbol("setTemp"))->Uint32Value());
-		report->controllerP = controller->Get(String::NewSymbol("P"))->Uint32Value();
-		report->controllerI = controller->Get(String::NewSymbol("I"))->Uint32Value();
-		report->controllerD = controller->Get(String::NewSymbol("D"))->Uint32Value();
+	info->Set(devicePathKey, String::New(devicePath));
+	// to be continued ...
 
-	report->sensorMinTemperature = Convert::toTemperature(settings->Get(String::NewSymbol("sensorMinTemperature"))->Uint32Value());
-	report->sensorMaxTemperature = Convert::toTemperature(settings->Get(String::NewSymbol("sensorMaxTemperature"))->Uint32Value());
-	report->fanMinimumPower = settings->Get(String::NewSymbol("fanMinimumPower"))->Uint32Value();
-	report->fanMaximumPower = settings->Get(String::NewSymbol("fanMaximumPower"))->Uint32Value();
-	report->ledSettings = settings->Get(String::NewSymbol("ledSettings"))->Uint32Value();
-	report->aquabusTimeout = settings->Get(String::NewSymbol("aquabusTimeout"))->Uint32Value();
+	return scope.Close(info);
+}
 
-	int bytes;
+/**
+ * Adds a field to a report layout
+ */
+static void layoutField(
+	Handle<Array> layout,
+	const char *name,
+	size_t offset,
+	size_t size,
+	const char *type,
+	int bit,
+	int bits
+) {
 
-	bytes = setFeatureReport(handle->NumberValue(), reportId->NumberValue(), buffer);
+	Local<Object> field = Object::New();
 
-	free(buffer);
+	field->Set(String::NewSymbol("name"), String::New(name));
+	field->Set(String::NewSymbol("offset"), Integer::New(offset));
+	field->Set(String::NewSymbol("size"), Integer::New(size));
+	field->Set(String::NewSymbol("type"), String::NewSymbol(type));
 
-	if(bytes <= 0)	{
-		ThrowException(Exception::Error(String::New("Couldn't set settings report")));
-		return Number::New(0);
+	if (bits > 0) {
+		field->Set(String::NewSymbol("bit"), Integer::New(bit));
+		field->Set(String::NewSymbol("bits"), Integer::New(bits));
 	}
 
-	return Number::New(1);
+	layout->Set(layout->Length(), field);
 }
 
-
 /**
- * Returns device information
- * @param Local<Value> handle
- * @return Local<Object> info
+ * Returns the byte layout of a raw report, generated from the schema tables
+ *
+ * Multibyte values are little endian.
+ *
+ * @param int reportId
+ * @return Local<Array> layout
  */
-Handle<Object> IO::getDeviceInfo(Local<Value> handle) {
+Handle<Array> IO::getReportLayout(int reportId) {
 
 	HandleScope scope;
-	Local<Object> info = Object::New();
+	Local<Array> layout = Array::New();
 
-	char procPath[24], devicePath[24];
+	std::vector<SchemaField> fields;
+	Schema::layout(reportId, &fields);
 
-	sprintf(procPath, "/proc/self/fd/\%d", handle->Int32Value());
+	for (size_t i = 0; i < fields.size(); i++) {
 
-	ssize_t len = readlink(procPath, devicePath, sizeof(devicePath));
-	devicePath[len] = '\0';
+		const SchemaField *field = &fields[i];
+		char type[8];
 
-	info->Set(String::NewSymbol("devicePath"), String::New(devicePath));
-	// to be continued ...
+		if (field->bits)
+			snprintf(type, sizeof(type), "bits");
+		else
+			snprintf(type, sizeof(type), "%sint%u", field->sign ? "" : "u", (unsigned int)(field->size * 8));
 
-	return scope.Close(info);
+		if (field->count == 1) {
+			layoutField(layout, field->member, field->offset, field->size, type, field->bit, field->bits);
+			continue;
+		}
+
+		for (size_t j = 0; j < field->count; j++) {
+			char name[48];
+			snprintf(name, sizeof(name), "%s[%u]", field->member, (unsigned int)j);
+			layoutField(layout, name, field->offset + j * field->size, field->size, type, 0, 0);
+		}
+	}
+
+	return scope.Close(layout);
 }
\ No newline at end of file
@@ -7,25 +7,29 @@
 #define IO_H
 
 #include <v8.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
 
 using namespace v8;
 
 class IO {
 
-	private:
+	public:
 
 		static const int REPORT_LENGTH = 512;
 
-	public:
+		// feature report ids
+		static const int DATA_REPORT = 4;
+		static const int SETTINGS_REPORT = 6;
 
-		static int openDevice(int vendorId, int productId);
-		static int isAquastreamXt(int handle, int vendorId, int productId);
-		static int getFeatureReport(int handle,	int reportId, unsigned char *buffer);
-		static int setFeatureReport(int handle,	int reportId, unsigned char *buffer);
-		static Handle<Object> getSettings(Local<Value> handle, Local<Value> reportId);
-		static Handle<Object> getData(Local<Value> handle, Local<Value> reportId, Handle<Object> settings);
-		static Handle<Value> setSettings(Local<Value> handle, Local<Value> reportId, Handle<Object> settings);
-		static Handle<Object> getDeviceInfo(Local<Value> handle);
+		// errors returned by getFeatureReport / setFeatureReport
+		static const int ERROR_REPORT_TOO_LARGE = -1;
+		static const int ERROR_GET_REPORT = -2;
+		static const int ERROR_GET_USAGES = -3;
+		static const int ERROR_SET_USAGES = -4;
+		static const int ERROR_SET_REPORT = -5;
+		static const int ERROR_GET_FIELD_INFO = -6;
 
 		struct pumpDataReport {
 
@@ -146,6 +150,30 @@ class IO {
 
 		} __attribute__((__packed__));
 
+		// Device access, safe to call outside of the V8 thread
+		static int openDevice(int vendorId, int productId);
+		static int openPath(const char *devicePath, int vendorId, int productId);
+		static int enumerate(int vendorId, int productId, std::vector<std::string> *paths);
+		static int findDevices(int vendorId, int productId, std::vector<std::string> *paths);
+		static int scanDevices(int vendorId, int productId, std::vector<std::string> *paths);
+		static int isAquastreamXt(int handle, int vendorId, int productId);
+		static int getReportLength(int handle, int reportId);
+		static int getFeatureReport(int handle, int reportId, unsigned char *buffer, size_t length);
+		static int getFeatureReport(int handle, int reportId, int reportLength, unsigned char *buffer, size_t length);
+		static int setFeatureReport(int handle, int reportId, const unsigned char *buffer, size_t length);
+		static int setFeatureReport(int handle, int reportId, int reportLength, const unsigned char *buffer, size_t length);
+		static int getDevicePath(int handle, char *devicePath, size_t length);
+		static const char *errorString(int error);
+
+		// Conversion between reports and V8 objects, V8 thread only
+		static void Init();
+		static Handle<Object> getData(const pumpDataReport *report, const pumpSettingsReport *settings);
+		static Handle<Object> getSettings(const pumpSettingsReport *report);
+		static void setSettings(Handle<Object> settings, pumpSettingsReport *report, pumpSettingsReport *mask);
+		static Handle<Object> getDeviceInfo(const char *devicePath);
+		static Handle<Array> getReportLayout(int reportId);
+		static Handle<String> hexByte(unsigned char value);
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,255 @@
+/**
+ * OpenMetrics text exposition
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "schema.h"
+
+/**
+ * A gauge of schema values, the path is a field or with a label a prefix:
+ * every field under it is a sample labeled with the rest of its path, the
+ * elements of an array field with their index
+ */
+struct MetricFamily {
+	const char *name;
+	const char *unit;
+	const char *help;
+	int reportId;
+	const char *path;
+	const char *label;
+	double divisor;
+};
+
+static const MetricFamily families[] = {
+	{ "aquastreamxt_temperature_celsius", "celsius", "Sensor temperature.",
+		IO::DATA_REPORT, "current.temperature.", "sensor", 1 },
+	{ "aquastreamxt_pump_frequency_hertz", "hertz", "Pump frequency.",
+		IO::DATA_REPORT, "current.frequency", NULL, 1 },
+	{ "aquastreamxt_pump_voltage_volts", "volts", "Pump supply voltage.",
+		IO::DATA_REPORT, "current.voltage", NULL, 1 },
+	{ "aquastreamxt_pump_current_amperes", "amperes", "Pump current.",
+		IO::DATA_REPORT, "current.pumpCurrent", NULL, 1000 },
+	{ "aquastreamxt_pump_power_watts", "watts", "Pump power.",
+		IO::DATA_REPORT, "current.pumpPower", NULL, 1 },
+	{ "aquastreamxt_flow", NULL, "Raw flow sensor value.",
+		IO::DATA_REPORT, "current.flow", NULL, 1 },
+	{ "aquastreamxt_fan_rpm", NULL, "Fan speed in revolutions per minute.",
+		IO::DATA_REPORT, "current.fanRpm", NULL, 1 },
+	{ "aquastreamxt_fan_voltage_volts", "volts", "Measured fan voltage.",
+		IO::DATA_REPORT, "current.fanVoltageMeasured", NULL, 1 },
+	{ "aquastreamxt_fan_power_ratio", "ratio", "Fan output power.",
+		IO::DATA_REPORT, "current.fanPower", NULL, 100 },
+	{ "aquastreamxt_alarm", NULL, "1 while the alarm is raised.",
+		IO::DATA_REPORT, "alarm.", "alarm", 1 },
+	{ "aquastreamxt_controller_output_ratio", "ratio", "Fan controller output.",
+		IO::DATA_REPORT, "controller.output", NULL, 100 },
+	{ "aquastreamxt_controller_target_celsius", "celsius", "Fan controller target temperature.",
+		IO::SETTINGS_REPORT, "controller.setTemp", NULL, 1 },
+	{ "aquastreamxt_sensor_alarm_celsius", "celsius", "Sensor alarm temperature.",
+		IO::SETTINGS_REPORT, "sensorAlarmTemperature", "sensor", 1 },
+	{ "aquastreamxt_fan_manual", NULL, "1 if the fan runs at a fixed power.",
+		IO::SETTINGS_REPORT, "fanMode.manual", NULL, 1 }
+};
+
+// labels of aquastreamxt_info, the serial is a label of every sample
+static const char *infoPaths[] = { "hardware.firmware", "hardware.bootloader", "hardware.hardware" };
+
+/**
+ * Resolves the families and the info labels against the schema tables
+ */
+Metrics::Metrics() {
+
+	length = 0;
+	labelSerial = -1;
+	timestampText[0] = 0;
+
+	buffer.resize(4096);
+
+	size_t count;
+	const SchemaField *fields;
+
+	for (size_t i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+
+		const MetricFamily *family = &families[i];
+		size_t length = strlen(family->path);
+
+		fields = Schema::fields(family->reportId, &count);
+
+		for (size_t j = 0; j < count; j++) {
+
+			if (family->label ? strncmp(fields[j].path, family->path, length) : strcmp(fields[j].path, family->path))
+				continue;
+
+			for (size_t k = 0; k < fields[j].count; k++) {
+
+				char index[8];
+				snprintf(index, sizeof(index), "%u", (unsigned int) k);
+
+				Series added;
+				added.family = family;
+				added.field = &fields[j];
+				added.index = k;
+				added.label = fields[j].count > 1 ? index : fields[j].path + length;
+
+				series.push_back(added);
+			}
+		}
+	}
+
+	fields = Schema::fields(IO::DATA_REPORT, &count);
+
+	for (size_t i = 0; i < sizeof(infoPaths) / sizeof(infoPaths[0]); i++) {
+		for (size_t j = 0; j < count; j++) {
+			if (!strcmp(fields[j].path, infoPaths[i]))
+				info.push_back(&fields[j]);
+		}
+	}
+};
+
+/**
+ * Appends printf style, grows the buffer if it doesn't fit
+ */
+void Metrics::append(const char *format, ...) {
+
+	while (true) {
+
+		va_list args;
+		va_start(args, format);
+		int written = vsnprintf(&buffer[length], buffer.size() - length, format, args);
+		va_end(args);
+
+		if (written < 0)
+			return;
+
+		if (length + written < buffer.size()) {
+			length += written;
+			return;
+		}
+
+		buffer.resize(buffer.size() * 2);
+	}
+};
+
+void Metrics::metric(const char *name, const char *type, const char *unit, const char *help) {
+
+	append("# TYPE %s %s\n", name, type);
+
+	if (unit)
+		append("# UNIT %s %s\n", name, unit);
+
+	append("# HELP %s %s\n", name, help);
+};
+
+/**
+ * One sample line, label is an extra name="value" pair or NULL
+ */
+void Metrics::sample(const char *name, const char *label, const char *value, double number) {
+
+	if (label)
+		append("%s{%s,%s=\"%s\"} %.10g%s\n", name, labelText.c_str(), label, value, number, timestampText);
+	else
+		append("%s{%s} %.10g%s\n", name, labelText.c_str(), number, timestampText);
+};
+
+/**
+ * Rebuilds the common labels when serial or device path changed
+ */
+void Metrics::labels(uint16_t serial, const char *devicePath) {
+
+	if (labelSerial == serial && labelPath == devicePath)
+		return;
+
+	labelSerial = serial;
+	labelPath = devicePath;
+
+	char number[8];
+	snprintf(number, sizeof(number), "%u", serial);
+
+	labelText = "serial=\"";
+	labelText += number;
+	labelText += "\",device_path=\"";
+
+	// label values escape backslash, quote and newline
+	for (const char *c = devicePath; *c; c++) {
+		if (*c == '\\' || *c == '"')
+			labelText += '\\';
+
+		if (*c == '\n')
+			labelText += "\\n";
+		else
+			labelText += *c;
+	}
+
+	labelText += '"';
+};
+
+/**
+ * Formats the metrics of a data report
+ *
+ * @param const IO::pumpDataReport *data
+ * @param const IO::pumpSettingsReport *settings
+ * @param const char *devicePath
+ * @param uint64_t timestamp CLOCK_REALTIME of the sample in ns, 0 = none
+ * @param size_t *length Length of the text
+ * @return const char* Valid until the next call
+ */
+const char *Metrics::format(
+	const IO::pumpDataReport *data,
+	const IO::pumpSettingsReport *settings,
+	const char *devicePath,
+	uint64_t timestamp,
+	size_t *length
+) {
+
+	this->length = 0;
+
+	labels(data->serial, devicePath);
+
+	if (timestamp)
+		snprintf(timestampText, sizeof(timestampText), " %llu.%03llu",
+			(unsigned long long)(timestamp / 1000000000),
+			(unsigned long long)(timestamp / 1000000 % 1000));
+	else
+		timestampText[0] = 0;
+
+	const MetricFamily *family = NULL;
+
+	for (size_t i = 0; i < series.size(); i++) {
+
+		const Series *current = &series[i];
+
+		if (current->family != family) {
+			family = current->family;
+			metric(family->name, "gauge", family->unit, family->help);
+		}
+
+		const unsigned char *report = family->reportId == IO::DATA_REPORT
+			? (const unsigned char*) data
+			: (const unsigned char*) settings;
+
+		double value = current->field->number(report, current->index, settings) / family->divisor;
+
+		sample(family->name, family->label, current->label.c_str(), value);
+	}
+
+	metric("aquastreamxt", "info", NULL, "Firmware and hardware versions.");
+	append("aquastreamxt_info{%s", labelText.c_str());
+
+	for (size_t i = 0; i < info.size(); i++)
+		append(",%s=\"%u\"", info[i]->path + strlen("hardware."), info[i]->raw((const unsigned char*) data, 0));
+
+	append("} 1\n");
+
+	append("# EOF\n");
+
+	*length = this->length;
+
+	return &buffer[0];
+};
@@ -0,0 +1,73 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "io.h"
+
+struct MetricFamily;
+struct SchemaField;
+
+/**
+ * Formats a data report and the relevant settings as OpenMetrics text
+ *
+ * The values come from the schema tables, see families in metrics.cc.
+ * The text is written into a buffer owned by the instance, which only grows,
+ * so repeated formatting doesn't allocate once it has its size.
+ */
+class Metrics {
+
+	public:
+
+		Metrics();
+
+		const char *format(
+			const IO::pumpDataReport *data,
+			const IO::pumpSettingsReport *settings,
+			const char *devicePath,
+			uint64_t timestamp,
+			size_t *length
+		);
+
+	private:
+
+		/**
+		 * A sample line, label is the value of the family's label
+		 */
+		struct Series {
+			const MetricFamily *family;
+			const SchemaField *field;
+			size_t index;
+			std::string label;
+		};
+
+		void labels(uint16_t serial, const char *devicePath);
+
+		void metric(const char *name, const char *type, const char *unit, const char *help);
+		void sample(const char *name, const char *label, const char *value, double number);
+		void append(const char *format, ...);
+
+		std::vector<char> buffer;
+		size_t length;
+
+		// serial="...",device_path="..." of the last call
+		std::string labelText;
+		std::string labelPath;
+		int labelSerial;
+
+		// " <seconds>" appended to each sample
+		char timestampText[32];
+
+		std::vector<Series> series;
+		std::vector<const SchemaField*> info;
+
+};
+
+#endif
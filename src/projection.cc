@@ -0,0 +1,240 @@
+/**
+ * Field projections of the data report
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <v8.h>
+#include <string.h>
+#include <map>
+
+#include "projection.h"
+#include "schema.h"
+
+using namespace v8;
+
+// compiled projections by their joined paths
+static std::map<std::string, Projection*> cache;
+static uint64_t uses = 0;
+
+Projection::Projection() {
+	root.field = NULL;
+	references = 1;
+	used = 0;
+};
+
+Projection::~Projection() {
+
+	for (size_t i = 0; i < root.children.size(); i++)
+		destroy(root.children[i]);
+
+	root.shape.Dispose();
+};
+
+void Projection::destroy(Node *node) {
+
+	for (size_t i = 0; i < node->children.size(); i++)
+		destroy(node->children[i]);
+
+	node->key.Dispose();
+	node->shape.Dispose();
+	delete node;
+};
+
+/**
+ * Returns the compiled projection of a field list, compiles it on first
+ * use. Throws and returns NULL if a field is unknown, release() it once
+ * the request is done.
+ * @param Handle<Array> paths
+ * @return Projection*
+ */
+Projection *Projection::get(Handle<Array> paths) {
+
+	std::string key;
+
+	for (uint32_t i = 0; i < paths->Length(); i++) {
+		key += *String::Utf8Value(paths->Get(i));
+		key += '\n';
+	}
+
+	Projection *projection;
+	std::map<std::string, Projection*>::iterator it = cache.find(key);
+
+	if (it != cache.end()) {
+		projection = it->second;
+	} else {
+
+		std::string error;
+		projection = compile(paths, &error);
+
+		if (!projection) {
+			ThrowException(Exception::TypeError(String::New(("Unknown field " + error).c_str())));
+			return NULL;
+		}
+
+		if (cache.size() >= CACHE_SIZE) {
+
+			std::map<std::string, Projection*>::iterator oldest = cache.begin();
+
+			for (it = cache.begin(); it != cache.end(); it++) {
+				if (it->second->used < oldest->second->used)
+					oldest = it;
+			}
+
+			Projection *evicted = oldest->second;
+			cache.erase(oldest);
+			evicted->release();
+		}
+
+		projection->key = key;
+		cache[key] = projection;
+	}
+
+	projection->used = ++uses;
+	projection->references++;
+
+	return projection;
+};
+
+/**
+ * Drops a reference from get(), frees the projection once it is evicted
+ * and no request uses it anymore
+ */
+void Projection::release() {
+
+	if (--references == 0)
+		delete this;
+};
+
+Projection *Projection::compile(Handle<Array> paths, std::string *error) {
+
+	HandleScope scope;
+	Projection *projection = new Projection();
+
+	size_t count;
+	const SchemaField *fields = Schema::fields(IO::DATA_REPORT, &count);
+
+	for (uint32_t i = 0; i < paths->Length(); i++) {
+
+		String::Utf8Value value(paths->Get(i));
+		std::string path(*value ? *value : "");
+		size_t length = path.length();
+		bool found = false;
+
+		for (size_t j = 0; j < count; j++) {
+
+			const char *candidate = fields[j].path;
+
+			if (!strncmp(candidate, path.c_str(), length) && (candidate[length] == 0 || candidate[length] == '.')) {
+				projection->add(&fields[j]);
+				found = true;
+			}
+		}
+
+		if (!found || length == 0) {
+			*error = path;
+			delete projection;
+			return NULL;
+		}
+	}
+
+	shape(&projection->root);
+
+	return projection;
+};
+
+/**
+ * Gives an object node and the objects below it a template with their
+ * selected keys
+ * @param Node *node
+ */
+void Projection::shape(Node *node) {
+
+	Local<ObjectTemplate> shape = ObjectTemplate::New();
+
+	for (size_t i = 0; i < node->children.size(); i++) {
+
+		shape->Set(node->children[i]->key, Undefined());
+
+		if (!node->children[i]->field)
+			Projection::shape(node->children[i]);
+	}
+
+	node->shape = Persistent<ObjectTemplate>::New(shape);
+};
+
+/**
+ * Adds a field, creating the objects on its path
+ * @param const SchemaField *field
+ */
+void Projection::add(const SchemaField *field) {
+
+	Node *parent = &root;
+	const char *start = field->path;
+
+	while (true) {
+
+		const char *end = strchr(start, '.');
+		std::string name = end ? std::string(start, end - start) : std::string(start);
+		Node *node = NULL;
+
+		for (size_t i = 0; i < parent->children.size(); i++) {
+			if (parent->children[i]->name == name) {
+				node = parent->children[i];
+				break;
+			}
+		}
+
+		if (!node) {
+			node = new Node();
+			node->name = name;
+			node->key = Persistent<String>::New(String::NewSymbol(name.c_str()));
+			node->field = end ? NULL : field;
+			parent->children.push_back(node);
+		}
+
+		if (!end)
+			return;
+
+		parent = node;
+		start = end + 1;
+	}
+};
+
+void Projection::build(
+	const Node *node,
+	Handle<Object> object,
+	const IO::pumpDataReport *report,
+	const IO::pumpSettingsReport *settings
+) const {
+
+	for (size_t i = 0; i < node->children.size(); i++) {
+
+		const Node *child = node->children[i];
+
+		if (child->field) {
+			object->Set(child->key, Schema::decodeField(child->field, (const unsigned char*) report, settings));
+		} else {
+			Local<Object> nested = child->shape->NewInstance();
+			build(child, nested, report, settings);
+			object->Set(child->key, nested);
+		}
+	}
+};
+
+/**
+ * Returns the selected fields of a data report
+ * @param const IO::pumpDataReport *report
+ * @param const IO::pumpSettingsReport *settings
+ * @return Handle<Object>
+ */
+Handle<Object> Projection::project(const IO::pumpDataReport *report, const IO::pumpSettingsReport *settings) const {
+
+	HandleScope scope;
+	Local<Object> data = root.shape->NewInstance();
+
+	build(&root, data, report, settings);
+
+	return scope.Close(data);
+};
@@ -0,0 +1,93 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <v8.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "io.h"
+#include "schema.h"
+
+/**
+ * A compiled selection of data report fields
+ *
+ * Builds the same nested object as IO::getData, but only with the
+ * selected values, so unselected fields are neither converted nor set.
+ * Objects are created from templates with the selected keys, so every
+ * result of a projection has the same hidden class.
+ *
+ * Compiled projections are shared by every Aquastream and
+ * AquastreamClient through a cache of CACHE_SIZE entries, see get().
+ * They are reference counted, so evicting one doesn't free it under a
+ * pending request. Event loop only.
+ */
+class Projection {
+
+	public:
+
+		// field selections kept compiled, the least recently used is evicted
+		static const size_t CACHE_SIZE = 64;
+
+		~Projection();
+
+		static Projection *get(v8::Handle<v8::Array> paths);
+		void release();
+
+		/**
+		 * Compiles field paths like "current.temperature.water", a path
+		 * of an object like "current.temperature" selects all its fields
+		 * @param Handle<Array> paths
+		 * @param std::string *error Set to the unknown path on failure
+		 * @return Projection* NULL on failure
+		 */
+		static Projection *compile(v8::Handle<v8::Array> paths, std::string *error);
+
+		v8::Handle<v8::Object> project(
+			const IO::pumpDataReport *report,
+			const IO::pumpSettingsReport *settings
+		) const;
+
+	private:
+
+		/**
+		 * A property of the result, either a field or an object
+		 */
+		struct Node {
+			std::string name;
+			v8::Persistent<v8::String> key;
+			const SchemaField *field;	// NULL for objects
+			v8::Persistent<v8::ObjectTemplate> shape;
+			std::vector<Node*> children;
+		};
+
+		Projection();
+
+		// the cache's reference and one per pending request
+		int references;
+
+		// cache key and the get() that last returned it
+		std::string key;
+		uint64_t used;
+
+		void add(const SchemaField *field);
+		static void shape(Node *node);
+		void build(
+			const Node *node,
+			v8::Handle<v8::Object> object,
+			const IO::pumpDataReport *report,
+			const IO::pumpSettingsReport *settings
+		) const;
+
+		static void destroy(Node *node);
+
+		Node root;
+
+};
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Shared memory reader
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <string>
+
+#include "reader.h"
+#include "io.h"
+
+using namespace v8;
+
+AquastreamReader::AquastreamReader(SharedReader *reader) : reader(reader) {};
+
+AquastreamReader::~AquastreamReader() {
+	delete reader;
+};
+
+void AquastreamReader::Init(Handle<Object> target) {
+
+	// Prepare constructor template
+	Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+	tpl->SetClassName(String::NewSymbol("AquastreamReader"));
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+	// Prototype
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("read"),
+		FunctionTemplate::New(Read)->GetFunction()
+	);
+
+	tpl->PrototypeTemplate()->Set(
+		String::NewSymbol("getRawReport"),
+		FunctionTemplate::New(GetRawReport)->GetFunction()
+	);
+
+	Persistent<Function> constructor = Persistent<Function>::New(tpl->GetFunction());
+	target->Set(String::NewSymbol("AquastreamReader"), constructor);
+};
+
+/**
+ * new AquastreamReader([name])
+ *
+ * Maps the segment of a publishing Aquastream, default "/aquastreamxt"
+ */
+Handle<Value> AquastreamReader::New(const Arguments& args) {
+
+	HandleScope scope;
+
+	std::string name = "/aquastreamxt";
+
+	if (args[0]->IsString())
+		name = *String::Utf8Value(args[0]);
+
+	SharedReader *reader = SharedReader::open(name.c_str());
+
+	if (!reader) {
+		ThrowException(Exception::Error(String::New("Couldn't open shared memory segment")));
+		return scope.Close(Undefined());
+	}
+
+	AquastreamReader *instance = new AquastreamReader(reader);
+	instance->Wrap(args.This());
+
+	return args.This();
+};
+
+/**
+ * read()
+ *
+ * Returns the last published sample, null if there is none yet. Throws if
+ * the publisher stopped in the middle of writing one.
+ * @return { timestamp, count, data }, timestamp in ms since the epoch
+ */
+Handle<Value> AquastreamReader::Read(const Arguments& args) {
+
+	HandleScope scope;
+
+	AquastreamReader *instance = ObjectWrap::Unwrap<AquastreamReader>(args.This());
+	SharedSample sample;
+	int status = instance->reader->read(&sample);
+
+	if (status == SharedReader::READ_INCONSISTENT) {
+		ThrowException(Exception::Error(String::New("No consistent sample, the publisher stopped while writing")));
+		return scope.Close(Undefined());
+	}
+
+	if (status == SharedReader::READ_EMPTY)
+		return scope.Close(Null());
+
+	Local<Object> result = Object::New();
+	result->Set(String::NewSymbol("timestamp"), Number::New(sample.timestamp / 1e6));
+	result->Set(String::NewSymbol("count"), Number::New(sample.count));
+	result->Set(String::NewSymbol("data"), IO::getData(&sample.data, &sample.settings));
+
+	return scope.Close(result);
+};
+
+/**
+ * getRawReport(reportId)
+ *
+ * Returns the last published data (4) or settings (6) report as a Buffer,
+ * null if there is none yet
+ */
+Handle<Value> AquastreamReader::GetRawReport(const Arguments& args) {
+
+	HandleScope scope;
+
+	int reportId = args[0]->Int32Value();
+
+	if (reportId != 4 && reportId != 6) {
+		ThrowException(Exception::TypeError(String::New("Invalid report id")));
+		return scope.Close(Undefined());
+	}
+
+	AquastreamReader *instance = ObjectWrap::Unwrap<AquastreamReader>(args.This());
+	SharedSample sample;
+	int status = instance->reader->read(&sample);
+
+	if (status == SharedReader::READ_INCONSISTENT) {
+		ThrowException(Exception::Error(String::New("No consistent sample, the publisher stopped while writing")));
+		return scope.Close(Undefined());
+	}
+
+	if (status == SharedReader::READ_EMPTY)
+		return scope.Close(Null());
+
+	const void *report = reportId == 4 ? (const void*) &sample.data : (const void*) &sample.settings;
+	size_t length = reportId == 4 ? sizeof(sample.data) : sizeof(sample.settings);
+
+	node::Buffer *buffer = node::Buffer::New((char*) report, length);
+
+	return scope.Close(buffer->handle_);
+};
@@ -0,0 +1,33 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include <node.h>
+
+#include "shared.h"
+
+/**
+ * Reads the samples an Aquastream publishes to shared memory
+ */
+class AquastreamReader: public node::ObjectWrap {
+
+	public:
+		static void Init(v8::Handle<v8::Object> target);
+
+	private:
+		AquastreamReader(SharedReader *reader);
+		~AquastreamReader();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Read(const v8::Arguments& args);
+	static v8::Handle<v8::Value> GetRawReport(const v8::Arguments& args);
+
+	SharedReader *reader;
+
+};
+
+#endif
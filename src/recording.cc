@@ -0,0 +1,527 @@
+/**
+ * Memory mapped recordings of data reports
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "recording.h"
+
+static const char RECORDING_MAGIC[8] = { 'A', 'Q', 'X', 'T', 'R', 'E', 'C', 0 };
+static const uint32_t RECORDING_VERSION = 1;
+
+// the layout is part of the file format
+typedef char recordingHeaderSize[sizeof(RecordingHeader) == 128 ? 1 : -1];
+typedef char recordingRecordSize[sizeof(RecordingRecord) == 80 ? 1 : -1];
+
+/**
+ * Segment number of a file name like "00000012.seg", -1 otherwise
+ */
+static int segmentNumber(const char *name) {
+
+	unsigned int number;
+	char suffix[5];
+
+	if (strlen(name) != 12 || sscanf(name, "%8u%4s", &number, suffix) != 2 || strcmp(suffix, ".seg"))
+		return -1;
+
+	return number;
+}
+
+/**
+ * Lists the segment files of a recording directory in order
+ */
+static std::vector<std::string> segmentFiles(const char *path) {
+
+	std::vector<int> numbers;
+	std::vector<std::string> files;
+	DIR *dir = opendir(path);
+
+	if (!dir)
+		return files;
+
+	struct dirent *entry;
+
+	while ((entry = readdir(dir))) {
+
+		int number = segmentNumber(entry->d_name);
+
+		if (number >= 0)
+			numbers.push_back(number);
+	}
+
+	closedir(dir);
+
+	std::sort(numbers.begin(), numbers.end());
+
+	for (size_t i = 0; i < numbers.size(); i++) {
+		char file[PATH_MAX];
+		snprintf(file, sizeof(file), "%s/%08u.seg", path, numbers[i]);
+		files.push_back(file);
+	}
+
+	return files;
+}
+
+static bool validHeader(const RecordingHeader *header) {
+	return !memcmp(header->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) &&
+		header->version == RECORDING_VERSION &&
+		header->recordSize == sizeof(RecordingRecord) &&
+		header->count <= header->capacity;
+}
+
+Recorder::Recorder(const char *path, uint32_t capacity, const IO::pumpSettingsReport *settings) {
+
+	this->path = path;
+	this->capacity = capacity > 0 ? capacity : DEFAULT_CAPACITY;
+	this->number = 0;
+	this->handle = -1;
+	this->segment = NULL;
+	this->mapped = 0;
+	this->last = 0;
+
+	memcpy(&this->settings, settings, sizeof(this->settings));
+};
+
+Recorder::~Recorder() {
+	closeSegment();
+};
+
+/**
+ * Opens a recording for appending, the directory is created if needed
+ *
+ * @param const char *path Directory of the segment files
+ * @param uint32_t capacity Records per new segment, 0 = DEFAULT_CAPACITY
+ * @param const IO::pumpSettingsReport *settings Stored with each segment
+ * @return Recorder* NULL if the directory can't be written
+ */
+Recorder *Recorder::open(const char *path, uint32_t capacity, const IO::pumpSettingsReport *settings) {
+
+	if (mkdir(path, 0755) < 0 && errno != EEXIST)
+		return NULL;
+
+	Recorder *recorder = new Recorder(path, capacity, settings);
+	std::vector<std::string> files = segmentFiles(path);
+
+	bool opened = false;
+
+	// continue the last segment unless it is full or from another version
+	if (!files.empty()) {
+
+		unsigned int last = segmentNumber(files.back().c_str() + files.back().length() - 12);
+
+		opened = recorder->openSegment(last, false) && recorder->segment->count < recorder->segment->capacity;
+
+		if (!opened) {
+			recorder->closeSegment();
+			opened = recorder->openSegment(last + 1, true);
+		}
+	} else {
+		opened = recorder->openSegment(0, true);
+	}
+
+	if (!opened) {
+		delete recorder;
+		return NULL;
+	}
+
+	return recorder;
+};
+
+/**
+ * Maps a segment, a new one is preallocated and gets a header
+ */
+bool Recorder::openSegment(unsigned int number, bool create) {
+
+	char file[PATH_MAX];
+	snprintf(file, sizeof(file), "%s/%08u.seg", path.c_str(), number);
+
+	handle = ::open(file, create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0644);
+
+	if (handle < 0)
+		return false;
+
+	struct stat info;
+
+	if (create) {
+		mapped = sizeof(RecordingHeader) + (size_t) capacity * sizeof(RecordingRecord);
+
+		if (ftruncate(handle, mapped) < 0)
+			return false;
+	} else {
+		if (fstat(handle, &info) < 0 || (size_t) info.st_size < sizeof(RecordingHeader))
+			return false;
+
+		mapped = info.st_size;
+	}
+
+	void *memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+	if (memory == MAP_FAILED)
+		return false;
+
+	segment = (RecordingHeader*) memory;
+	this->number = number;
+
+	if (!create && validHeader(segment) && segment->count)
+		last = segment->last;
+
+	if (create) {
+		memcpy(segment->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+		segment->version = RECORDING_VERSION;
+		segment->recordSize = sizeof(RecordingRecord);
+		segment->capacity = capacity;
+		segment->count = 0;
+		segment->first = 0;
+		segment->last = 0;
+		memcpy(segment->settings, &settings, sizeof(settings));
+	}
+
+	return validHeader(segment) && mapped >= sizeof(RecordingHeader) + (size_t) segment->capacity * sizeof(RecordingRecord);
+};
+
+void Recorder::closeSegment() {
+
+	if (segment)
+		munmap(segment, mapped);
+
+	if (handle >= 0)
+		close(handle);
+
+	segment = NULL;
+	handle = -1;
+};
+
+/**
+ * Appends a record, timestamps going backwards are clamped to the last
+ * one so the segments stay sorted
+ *
+ * @param uint64_t timestamp CLOCK_REALTIME in ns
+ * @param const IO::pumpDataReport *report
+ * @return bool false if a new segment couldn't be started
+ */
+bool Recorder::append(uint64_t timestamp, const IO::pumpDataReport *report) {
+
+	if (!segment)
+		return false;
+
+	if (segment->count == segment->capacity) {
+
+		unsigned int next = number + 1;
+
+		closeSegment();
+
+		if (!openSegment(next, true)) {
+			closeSegment();
+			return false;
+		}
+	}
+
+	uint32_t count = segment->count;
+	RecordingRecord *record = (RecordingRecord*) (segment + 1) + count;
+
+	if (timestamp < last)
+		timestamp = last;
+
+	record->timestamp = timestamp;
+	memcpy(record->data, report, sizeof(record->data));
+	memset(record->reserved, 0, sizeof(record->reserved));
+
+	if (count == 0)
+		segment->first = timestamp;
+
+	segment->last = timestamp;
+	last = timestamp;
+
+	__atomic_store_n(&segment->count, count + 1, __ATOMIC_RELEASE);
+
+	return true;
+};
+
+/**
+ * Settings for decoding the following records
+ *
+ * Records already in the segment were decoded with its header settings, so
+ * changed settings start a new segment, unless the segment is still empty
+ * and its header can be updated. If the new segment can't be started,
+ * append() fails.
+ *
+ * @param const IO::pumpSettingsReport *settings
+ */
+void Recorder::setSettings(const IO::pumpSettingsReport *settings) {
+
+	memcpy(&this->settings, settings, sizeof(this->settings));
+
+	if (!segment || !memcmp(segment->settings, settings, sizeof(segment->settings)))
+		return;
+
+	if (!segment->count) {
+		memcpy(segment->settings, settings, sizeof(segment->settings));
+		return;
+	}
+
+	unsigned int next = number + 1;
+
+	closeSegment();
+
+	if (!openSegment(next, true))
+		closeSegment();
+};
+
+RecordingReader::RecordingReader() {
+};
+
+RecordingReader::~RecordingReader() {
+
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (segments[i].header)
+			munmap((void*) segments[i].header, segments[i].mapped);
+	}
+};
+
+/**
+ * Opens a recording directory or a single segment file
+ *
+ * Records appended after open() aren't seen. Only the headers are read.
+ *
+ * @param const char *path
+ * @return RecordingReader* NULL if there is no segment with records
+ */
+RecordingReader *RecordingReader::open(const char *path) {
+
+	struct stat info;
+
+	if (stat(path, &info) < 0)
+		return NULL;
+
+	std::vector<std::string> files;
+
+	if (S_ISDIR(info.st_mode))
+		files = segmentFiles(path);
+	else
+		files.push_back(path);
+
+	RecordingReader *reader = new RecordingReader();
+
+	for (size_t i = 0; i < files.size(); i++) {
+
+		int handle = ::open(files[i].c_str(), O_RDONLY);
+
+		if (handle < 0)
+			continue;
+
+		RecordingHeader header;
+		bool valid = pread(handle, &header, sizeof(header), 0) == sizeof(header) && validHeader(&header);
+
+		close(handle);
+
+		if (!valid || !header.count)
+			continue;
+
+		Segment segment;
+		segment.path = files[i];
+		segment.first = header.first;
+		segment.last = header.last;
+		segment.count = header.count;
+		segment.header = NULL;
+		segment.mapped = 0;
+		memcpy(segment.settings, header.settings, sizeof(segment.settings));
+
+		reader->segments.push_back(segment);
+	}
+
+	if (reader->segments.empty()) {
+		delete reader;
+		return NULL;
+	}
+
+	return reader;
+};
+
+/**
+ * Maps a segment on first access
+ * @return const RecordingRecord* NULL if it can't be mapped
+ */
+const RecordingRecord *RecordingReader::records(size_t index) {
+
+	Segment *segment = &segments[index];
+
+	if (!segment->header) {
+
+		int handle = ::open(segment->path.c_str(), O_RDONLY);
+
+		if (handle < 0)
+			return NULL;
+
+		size_t length = sizeof(RecordingHeader) + (size_t) segment->count * sizeof(RecordingRecord);
+		// writable but private, readRecording() hands the records to JS as Buffers
+		void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+
+		close(handle);
+
+		if (memory == MAP_FAILED)
+			return NULL;
+
+		segment->header = (const RecordingHeader*) memory;
+		segment->mapped = length;
+	}
+
+	return (const RecordingRecord*) (segment->header + 1);
+};
+
+/**
+ * Position of the first record at or after timestamp
+ * @param uint64_t timestamp CLOCK_REALTIME in ns
+ * @return RecordingPosition The end if there is none
+ */
+RecordingPosition RecordingReader::seek(uint64_t timestamp) {
+
+	RecordingPosition position;
+	size_t low = 0, high = segments.size();
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (segments[middle].last < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	position.segment = low;
+	position.record = 0;
+
+	if (low == segments.size())
+		return position;
+
+	const RecordingRecord *data = records(low);
+
+	if (!data)
+		return position;
+
+	size_t first = 0, last = segments[low].count;
+
+	while (first < last) {
+		size_t middle = first + (last - first) / 2;
+
+		if (data[middle].timestamp < timestamp)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	position.record = first;
+
+	return position;
+};
+
+/**
+ * Returns the record at position and advances it
+ * @param RecordingPosition *position
+ * @return const RecordingRecord* NULL at the end
+ */
+const RecordingRecord *RecordingReader::next(RecordingPosition *position) {
+
+	while (position->segment < segments.size()) {
+
+		if (position->record < segments[position->segment].count) {
+
+			const RecordingRecord *data = records(position->segment);
+
+			if (data)
+				return &data[position->record++];
+		}
+
+		position->segment++;
+		position->record = 0;
+	}
+
+	return NULL;
+};
+
+/**
+ * Returns the records from position up to the end of its segment or the
+ * first one at or after to, and advances position past them. Segments
+ * that can't be mapped are skipped, position->segment is the segment of
+ * the records returned.
+ * @param RecordingPosition *position
+ * @param uint64_t to CLOCK_REALTIME in ns
+ * @param size_t *count Set to the number of records
+ * @return const RecordingRecord* NULL at the end
+ */
+const RecordingRecord *RecordingReader::span(RecordingPosition *position, uint64_t to, size_t *count) {
+
+	while (position->segment < segments.size()) {
+
+		size_t last = segments[position->segment].count;
+		const RecordingRecord *data = position->record < last ? records(position->segment) : NULL;
+
+		if (data) {
+
+			size_t first = position->record, low = first, high = last;
+
+			while (low < high) {
+				size_t middle = low + (high - low) / 2;
+
+				if (data[middle].timestamp < to)
+					low = middle + 1;
+				else
+					high = middle;
+			}
+
+			if (low == first)
+				return NULL;
+
+			*count = low - first;
+			position->record = low;
+
+			return data + first;
+		}
+
+		position->segment++;
+		position->record = 0;
+	}
+
+	return NULL;
+};
+
+/**
+ * Number of records
+ * @return uint64_t
+ */
+uint64_t RecordingReader::size() const {
+
+	uint64_t count = 0;
+
+	for (size_t i = 0; i < segments.size(); i++)
+		count += segments[i].count;
+
+	return count;
+};
+
+/**
+ * Settings report stored with a segment, the one its records are decoded with
+ * @param size_t segment
+ * @param IO::pumpSettingsReport *settings
+ * @return bool
+ */
+bool RecordingReader::settings(size_t segment, IO::pumpSettingsReport *settings) const {
+
+	if (segment >= segments.size())
+		return false;
+
+	memcpy(settings, segments[segment].settings, sizeof(*settings));
+
+	return true;
+};
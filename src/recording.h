@@ -0,0 +1,137 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "io.h"
+
+/**
+ * Header at the start of every segment file, see doc/recording-format.md
+ */
+struct RecordingHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t capacity;
+
+	// records written, updated after each record so readers never see a partial one
+	uint32_t count;
+
+	// CLOCK_REALTIME ns of the first and last record, the sparse time index
+	uint64_t first;
+	uint64_t last;
+
+	// settings report of all records in the segment, needed to decode fan rpm
+	unsigned char settings[sizeof(IO::pumpSettingsReport)];
+	unsigned char reserved[128 - 40 - sizeof(IO::pumpSettingsReport)];
+};
+
+/**
+ * A data report with its CLOCK_REALTIME timestamp in ns
+ */
+struct RecordingRecord {
+	uint64_t timestamp;
+	unsigned char data[sizeof(IO::pumpDataReport)];
+	unsigned char reserved[80 - 8 - sizeof(IO::pumpDataReport)];
+};
+
+/**
+ * Appends data reports to a directory of fixed size segment files
+ *
+ * Segments are preallocated and written through a shared mapping, so an
+ * append is a memcpy. A new segment is started when one is full or the
+ * settings change; a recorder opened on an existing recording continues its
+ * last segment.
+ */
+class Recorder {
+
+	public:
+
+		static const uint32_t DEFAULT_CAPACITY = 65536;
+
+		static Recorder *open(const char *path, uint32_t capacity, const IO::pumpSettingsReport *settings);
+		~Recorder();
+
+		bool append(uint64_t timestamp, const IO::pumpDataReport *report);
+		void setSettings(const IO::pumpSettingsReport *settings);
+
+	private:
+
+		Recorder(const char *path, uint32_t capacity, const IO::pumpSettingsReport *settings);
+
+		bool openSegment(unsigned int number, bool create);
+		void closeSegment();
+
+		std::string path;
+		uint32_t capacity;
+		IO::pumpSettingsReport settings;
+
+		unsigned int number;
+		int handle;
+		RecordingHeader *segment;
+		size_t mapped;
+
+		// timestamp of the last record, also of the previous segments
+		uint64_t last;
+
+};
+
+/**
+ * Position of a record in a recording
+ */
+struct RecordingPosition {
+	size_t segment;
+	size_t record;
+};
+
+/**
+ * Reads a recording through private mappings
+ *
+ * open() only reads the segment headers, segments are mapped on first
+ * access. seek() is a binary search over the segment time ranges and then
+ * over the records of one segment. Records returned by next() and span()
+ * point into the mappings and stay valid until the reader is deleted.
+ * Writes to them stay private to the process, the files aren't changed.
+ */
+class RecordingReader {
+
+	public:
+
+		static RecordingReader *open(const char *path);
+		~RecordingReader();
+
+		RecordingPosition seek(uint64_t timestamp);
+		const RecordingRecord *next(RecordingPosition *position);
+		const RecordingRecord *span(RecordingPosition *position, uint64_t to, size_t *count);
+
+		uint64_t size() const;
+		bool settings(size_t segment, IO::pumpSettingsReport *settings) const;
+
+	private:
+
+		RecordingReader();
+
+		struct Segment {
+			std::string path;
+			uint64_t first;
+			uint64_t last;
+			uint32_t count;
+			unsigned char settings[sizeof(IO::pumpSettingsReport)];
+			const RecordingHeader *header;
+			size_t mapped;
+		};
+
+		const RecordingRecord *records(size_t segment);
+
+		std::vector<Segment> segments;
+
+};
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * File backed replay transport
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+
+#include "replay.h"
+#include "io.h"
+
+ReplayBackend::ReplayBackend(const char *path, double rate) {
+
+	this->path = path;
+	this->interval = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+	this->next = 0;
+	this->recording = NULL;
+	this->segment = 0;
+	this->changed = false;
+};
+
+ReplayBackend::~ReplayBackend() {
+	delete recording;
+};
+
+/**
+ * Loads a recording
+ *
+ * @param const char *path
+ * @param double rate Reads per second, 0 = as fast as possible
+ * @return ReplayBackend* NULL if the file can't be read or is empty
+ */
+ReplayBackend *ReplayBackend::open(const char *path, double rate) {
+
+	RecordingReader *recording = RecordingReader::open(path);
+
+	if (recording) {
+
+		ReplayBackend *backend = new ReplayBackend(path, rate);
+		IO::pumpSettingsReport settings;
+
+		// operator[] binds a reference, the bench target doesn't link io.cc
+		int reportId = IO::SETTINGS_REPORT;
+
+		recording->settings(0, &settings);
+
+		backend->recording = recording;
+		backend->position = recording->seek(0);
+		backend->reports[reportId].push_back(
+			std::vector<unsigned char>((unsigned char*) &settings, (unsigned char*) &settings + sizeof(settings))
+		);
+
+		return backend;
+	}
+
+	FILE *file = fopen(path, "rb");
+
+	if (!file)
+		return NULL;
+
+	ReplayBackend *backend = new ReplayBackend(path, rate);
+	unsigned char header[3];
+
+	while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+
+		size_t length = header[1] | (header[2] << 8);
+		std::vector<unsigned char> report(length);
+
+		if (length == 0 || length > IO::REPORT_LENGTH)
+			break;
+
+		if (fread(&report[0], 1, length, file) != length)
+			break;
+
+		backend->reports[header[0]].push_back(report);
+	}
+
+	fclose(file);
+
+	if (backend->reports.empty()) {
+		delete backend;
+		return NULL;
+	}
+
+	return backend;
+};
+
+/**
+ * Takes the next read slot and sleeps until it is due. Runs without the
+ * device lock, concurrent callers get consecutive slots.
+ */
+void ReplayBackend::pace() {
+
+	if (!interval)
+		return;
+
+	struct timespec clock;
+	clock_gettime(CLOCK_MONOTONIC, &clock);
+
+	uint64_t now = (uint64_t) clock.tv_sec * 1000000000 + clock.tv_nsec;
+	uint64_t slot = __atomic_load_n(&next, __ATOMIC_RELAXED);
+	uint64_t due;
+
+	do {
+		due = slot > now ? slot : now;
+	} while (!__atomic_compare_exchange_n(&next, &slot, due + interval, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	if (now < due) {
+		struct timespec ts;
+		ts.tv_sec = (due - now) / 1000000000;
+		ts.tv_nsec = (due - now) % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+};
+
+int ReplayBackend::getFeatureReport(int reportId, unsigned char *buffer, size_t length) {
+
+	if (recording && reportId == IO::DATA_REPORT) {
+
+		const RecordingRecord *record = recording->next(&position);
+
+		if (!record) {
+			position = recording->seek(0);
+			record = recording->next(&position);
+		}
+
+		// no segment could be mapped
+		if (!record)
+			return IO::ERROR_GET_REPORT;
+
+		// records are decoded with the settings of their segment
+		if (position.segment != segment) {
+
+			IO::pumpSettingsReport settings;
+			int settingsId = IO::SETTINGS_REPORT;
+			std::vector<unsigned char> &report = reports[settingsId][0];
+
+			segment = position.segment;
+			recording->settings(segment, &settings);
+
+			if (memcmp(&report[0], &settings, std::min(report.size(), sizeof(settings)))) {
+				report.assign((unsigned char*) &settings, (unsigned char*) &settings + sizeof(settings));
+				changed = true;
+			}
+		}
+
+		memset(buffer, 0, length);
+		memcpy(buffer, record->data, sizeof(record->data) < length ? sizeof(record->data) : length);
+
+		return sizeof(record->data) + 1;
+	}
+
+	std::map<int, std::vector<std::vector<unsigned char> > >::iterator records = reports.find(reportId);
+
+	if (records == reports.end())
+		return IO::ERROR_GET_REPORT;
+
+	size_t &position = positions[reportId];
+	const std::vector<unsigned char> &report = records->second[position];
+
+	position = (position + 1) % records->second.size();
+
+	memset(buffer, 0, length);
+	memcpy(buffer, &report[0], report.size() < length ? report.size() : length);
+
+	return report.size() + 1;
+};
+
+int ReplayBackend::setFeatureReport(int reportId, const unsigned char *buffer, size_t length) {
+
+	std::vector<std::vector<unsigned char> > &records = reports[reportId];
+
+	records.clear();
+	records.push_back(std::vector<unsigned char>(buffer, buffer + length));
+	positions[reportId] = 0;
+
+	return length + 1;
+};
+
+int ReplayBackend::getDevicePath(char *devicePath, size_t length) {
+
+	snprintf(devicePath, length, "%s", path.c_str());
+
+	return strlen(devicePath);
+};
+
+bool ReplayBackend::settingsChanged() {
+
+	bool result = changed;
+	changed = false;
+
+	return result;
+};
@@ -0,0 +1,67 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+#include "recording.h"
+
+/**
+ * Replays recorded feature reports from a file
+ *
+ * The file is a sequence of records: report id (uint8), length (uint16 LE),
+ * followed by the packed report (see doc/report-layout.md). Reads return
+ * the records of a report id in order, starting over at the end. Writes
+ * replace the report, so settings round trip like on a real device.
+ *
+ * A recording made with Recorder (a directory or one segment file) is
+ * replayed as well, its data reports in order and the settings report
+ * stored with it.
+ */
+class ReplayBackend: public Backend {
+
+	public:
+
+		static ReplayBackend *open(const char *path, double rate);
+		~ReplayBackend();
+
+		int getFeatureReport(int reportId, unsigned char *buffer, size_t length);
+		int setFeatureReport(int reportId, const unsigned char *buffer, size_t length);
+		int getDevicePath(char *devicePath, size_t length);
+		bool settingsChanged();
+		void pace();
+
+	private:
+
+		ReplayBackend(const char *path, double rate);
+
+		std::string path;
+
+		// recorded reports by report id, and the next one to return
+		std::map<int, std::vector<std::vector<unsigned char> > > reports;
+		std::map<int, size_t> positions;
+
+		// data reports of a recording, NULL for the plain format
+		RecordingReader *recording;
+		RecordingPosition position;
+
+		// segment whose settings are the settings report, set when they differ
+		size_t segment;
+		bool changed;
+
+		// minimum time between two reads in ns, 0 = unlimited, and the
+		// next free slot; pace() runs unlocked, so next is atomic
+		uint64_t interval;
+		uint64_t next;
+
+};
+
+#endif
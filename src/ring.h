@@ -0,0 +1,189 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_CACHE_LINE 64
+
+/**
+ * Lock-free single producer / single consumer ring buffer
+ *
+ * The producer never blocks: when the consumer falls behind the oldest
+ * items are overwritten and counted as dropped. Every slot carries a
+ * sequence number (odd while being written), so the consumer can detect
+ * a slot that was overwritten while it was copying it.
+ *
+ * T must be trivially copyable.
+ */
+template <typename T>
+class Ring {
+
+	public:
+
+		Ring(size_t capacity);
+		~Ring();
+
+		// producer side
+		void push(const T &item);
+
+		// consumer side
+		size_t drain(T *items, size_t max);
+		uint64_t dropped() const;
+
+		size_t size() const;
+		size_t capacity() const;
+
+	private:
+
+		struct Slot {
+			uint64_t sequence;
+			T item;
+		};
+
+		// allocated separately, so the ring itself needs no extended alignment
+		struct Cursors {
+
+			// written by the producer only
+			uint64_t head __attribute__((aligned(RING_CACHE_LINE)));
+
+			// written by the consumer only
+			uint64_t tail __attribute__((aligned(RING_CACHE_LINE)));
+			uint64_t drops;
+		};
+
+		Slot *slots;
+		Cursors *cursors;
+		size_t mask;
+
+};
+
+/**
+ * @param size_t capacity Rounded up to a power of two
+ */
+template <typename T>
+Ring<T>::Ring(size_t capacity) {
+
+	size_t size = 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	if (posix_memalign((void**) &slots, RING_CACHE_LINE, size * sizeof(Slot)) != 0 ||
+		posix_memalign((void**) &cursors, RING_CACHE_LINE, sizeof(Cursors)) != 0)
+		abort();
+
+	memset(slots, 0, size * sizeof(Slot));
+	memset(cursors, 0, sizeof(Cursors));
+
+	mask = size - 1;
+};
+
+template <typename T>
+Ring<T>::~Ring() {
+	free(slots);
+	free(cursors);
+};
+
+/**
+ * Appends an item, overwriting the oldest one if the ring is full
+ * @param const T &item
+ */
+template <typename T>
+void Ring<T>::push(const T &item) {
+
+	uint64_t position = __atomic_load_n(&cursors->head, __ATOMIC_RELAXED);
+	Slot *slot = &slots[position & mask];
+
+	__atomic_store_n(&slot->sequence, (position << 1) | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(&slot->item, &item, sizeof(T));
+
+	__atomic_store_n(&slot->sequence, (position + 1) << 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&cursors->head, position + 1, __ATOMIC_RELEASE);
+};
+
+/**
+ * Moves up to max of the oldest items to items
+ * @param T *items
+ * @param size_t max
+ * @return size_t Number of items copied
+ */
+template <typename T>
+size_t Ring<T>::drain(T *items, size_t max) {
+
+	size_t count = 0;
+	uint64_t position = cursors->tail;
+
+	while (count < max) {
+
+		uint64_t end = __atomic_load_n(&cursors->head, __ATOMIC_ACQUIRE);
+
+		// skip what was overwritten
+		if (end - position > mask + 1) {
+			cursors->drops += end - (mask + 1) - position;
+			position = end - (mask + 1);
+		}
+
+		if (position == end)
+			break;
+
+		Slot *slot = &slots[position & mask];
+		uint64_t expected = (position + 1) << 1;
+
+		uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		memcpy(&items[count], &slot->item, sizeof(T));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint64_t after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+		// overwritten while copying, resync with head
+		if (before != expected || after != expected) {
+			cursors->drops++;
+			position++;
+			continue;
+		}
+
+		count++;
+		position++;
+	}
+
+	__atomic_store_n(&cursors->tail, position, __ATOMIC_RELEASE);
+
+	return count;
+};
+
+/**
+ * Number of items lost to overwrites, consumer side
+ * @return uint64_t
+ */
+template <typename T>
+uint64_t Ring<T>::dropped() const {
+	return cursors->drops;
+};
+
+/**
+ * Number of items waiting
+ * @return size_t
+ */
+template <typename T>
+size_t Ring<T>::size() const {
+
+	uint64_t end = __atomic_load_n(&cursors->head, __ATOMIC_ACQUIRE);
+	uint64_t position = __atomic_load_n(&cursors->tail, __ATOMIC_ACQUIRE);
+
+	return end - position > mask + 1 ? mask + 1 : end - position;
+};
+
+template <typename T>
+size_t Ring<T>::capacity() const {
+	return mask + 1;
+};
+
+#endif
@@ -0,0 +1,257 @@
+/**
+ * Native background sampler
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <node.h>
+#include <v8.h>
+#include <time.h>
+
+#include "sampler.h"
+#include "aquastreamxt.h"
+#include "async.h"
+#include "io.h"
+#include "history.h"
+#include "deadband.h"
+#include "adaptive.h"
+
+using namespace v8;
+
+Sampler::Sampler(
+	Aquastream *aquastream,
+	unsigned int intervalMs,
+	unsigned int batchSize,
+	unsigned int capacity,
+	Deadband *deadband,
+	AdaptiveInterval *adaptive,
+	Handle<Function> callback
+) : ring(capacity) {
+
+	this->aquastream = aquastream;
+	this->callback = Persistent<Function>::New(callback);
+	this->interval = (uint64_t)intervalMs * 1000000;
+	this->batchSize = batchSize > 0 ? batchSize : 1;
+	this->deadband = deadband;
+	this->adaptive = adaptive;
+	this->running = false;
+	this->stopping = false;
+	this->unsignaled = 0;
+	this->error = 0;
+
+	uv_mutex_init(&stateLock);
+	uv_cond_init(&stateCond);
+
+	batch.resize(ring.capacity());
+
+	uv_async_init(uv_default_loop(), &async, deliver);
+	async.data = this;
+};
+
+Sampler::~Sampler() {
+
+	callback.Dispose();
+
+	delete deadband;
+	delete adaptive;
+
+	uv_mutex_destroy(&stateLock);
+	uv_cond_destroy(&stateCond);
+};
+
+/**
+ * Returns the CLOCK_MONOTONIC time in ns
+ * @return uint64_t
+ */
+uint64_t Sampler::now() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+};
+
+/**
+ * Starts the sampling thread
+ */
+void Sampler::start() {
+
+	running = true;
+	uv_thread_create(&thread, run, this);
+};
+
+/**
+ * Stops the thread, delivers the remaining samples and frees the sampler
+ * once libuv has released the async handle
+ */
+void Sampler::stop() {
+
+	if (stopping)
+		return;
+
+	stopping = true;
+
+	uv_mutex_lock(&stateLock);
+	running = false;
+	uv_cond_signal(&stateCond);
+	uv_mutex_unlock(&stateLock);
+
+	uv_thread_join(&thread);
+
+	flush();
+
+	uv_close((uv_handle_t*) &async, closed);
+};
+
+/**
+ * Sampling thread, reads the data report every interval ns, or as often
+ * as the adaptive interval says
+ */
+void Sampler::run(void *arg) {
+
+	Sampler *sampler = static_cast<Sampler*>(arg);
+	Aquastream *aquastream = sampler->aquastream;
+
+	uint64_t next = now();
+
+	uv_mutex_lock(&sampler->stateLock);
+
+	while (sampler->running) {
+
+		uv_mutex_unlock(&sampler->stateLock);
+
+		Sample sample;
+		IO::pumpSettingsReport settings;
+
+		int ret = aquastream->device->readData(&sample.data, &settings);
+
+		sample.timestamp = now();
+		sample.changed = 0;
+
+		if (ret >= 0 && sampler->deadband)
+			sample.changed = sampler->deadband->compare(&sample.data, &settings);
+
+		// never blocks, the ring overwrites if JS falls behind. Unchanged
+		// samples are queued too, history, recording and metrics need
+		// every read; a change is signaled right away
+		if (ret < 0) {
+			__atomic_store_n(&sampler->error, ret, __ATOMIC_RELEASE);
+			uv_async_send(&sampler->async);
+		} else {
+			sampler->ring.push(sample);
+
+			if (++sampler->unsignaled >= sampler->batchSize || sample.changed) {
+				sampler->unsignaled = 0;
+				uv_async_send(&sampler->async);
+			}
+		}
+
+		uint64_t interval = sampler->interval;
+
+		if (ret >= 0 && sampler->adaptive)
+			interval = sampler->adaptive->update(sample.timestamp, &sample.data);
+
+		// fixed rate, ticks that were missed are skipped
+		next += interval;
+		uint64_t current = now();
+
+		if (next <= current)
+			next += ((current - next) / interval + 1) * interval;
+
+		uv_mutex_lock(&sampler->stateLock);
+
+		while (sampler->running && (current = now()) < next)
+			uv_cond_timedwait(&sampler->stateCond, &sampler->stateLock, next - current);
+	}
+
+	uv_mutex_unlock(&sampler->stateLock);
+};
+
+/**
+ * Async callback on the event loop
+ */
+void Sampler::deliver(uv_async_t *async, int status) {
+	static_cast<Sampler*>(async->data)->flush();
+};
+
+/**
+ * Drains the ring and hands the samples to the callback as
+ * [{ timestamp, data }, ...], or [{ timestamp, changes }, ...] of the
+ * samples with changes with a deadband, timestamp in ms. Every sample goes
+ * to Aquastream::sampled.
+ */
+void Sampler::flush() {
+
+	HandleScope scope;
+
+	int error = __atomic_exchange_n(&this->error, 0, __ATOMIC_ACQUIRE);
+
+	if (error < 0)
+		Async::complete(callback, Async::error(IO::errorString(error)), Undefined());
+
+	size_t count = ring.drain(&batch[0], batch.size());
+
+	if (count == 0)
+		return;
+
+	// samples are decoded with the current settings
+	IO::pumpSettingsReport settings;
+
+	aquastream->device->cachedSettings(&settings);
+
+	Local<Array> samples = Array::New();
+	uint32_t delivered = 0;
+
+	for (size_t i = 0; i < count; i++) {
+
+		aquastream->sampled(batch[i].timestamp, &batch[i].data);
+
+		if (deadband && !batch[i].changed)
+			continue;
+
+		Local<Object> sample = Object::New();
+
+		sample->Set(String::NewSymbol("timestamp"), Number::New(batch[i].timestamp / 1e6));
+		if (deadband)
+			sample->Set(String::NewSymbol("changes"), deadband->changes(batch[i].changed, &batch[i].data, &settings));
+		else
+			sample->Set(String::NewSymbol("data"), IO::getData(&batch[i].data, &settings));
+
+		samples->Set(delivered++, sample);
+	}
+
+	if (delivered > 0)
+		Async::complete(callback, Null(), samples);
+};
+
+/**
+ * Returns { running, buffered, dropped, capacity, intervalMs, rate }, rate
+ * in reads per second
+ * @return Local<Object>
+ */
+Handle<Object> Sampler::getStatus() {
+
+	HandleScope scope;
+	Local<Object> status = Object::New();
+
+	status->Set(String::NewSymbol("running"), Boolean::New(running));
+	status->Set(String::NewSymbol("buffered"), Integer::NewFromUnsigned(ring.size()));
+	status->Set(String::NewSymbol("dropped"), Number::New(ring.dropped()));
+	status->Set(String::NewSymbol("capacity"), Integer::NewFromUnsigned(ring.capacity()));
+
+	uint64_t current = adaptive ? adaptive->interval() : interval;
+
+	status->Set(String::NewSymbol("intervalMs"), Number::New(current / 1e6));
+	status->Set(String::NewSymbol("rate"), Number::New(1e9 / current));
+
+	return scope.Close(status);
+};
+
+void Sampler::closed(uv_handle_t *handle) {
+
+	Sampler *sampler = static_cast<Sampler*>(handle->data);
+
+	sampler->aquastream->Unref();
+	delete sampler;
+};
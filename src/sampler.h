@@ -0,0 +1,103 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <node.h>
+#include <uv.h>
+#include <vector>
+
+#include "io.h"
+#include "ring.h"
+
+class Aquastream;
+class Deadband;
+class AdaptiveInterval;
+
+/**
+ * A data report with its CLOCK_MONOTONIC timestamp in ns
+ */
+struct Sample {
+	uint64_t timestamp;
+	IO::pumpDataReport data;
+
+	// fields changed beyond their deadband, see Deadband::compare
+	uint64_t changed;
+};
+
+/**
+ * Polls the data report on a native thread at a fixed or adaptive rate
+ * and hands the samples to JS in batches
+ */
+class Sampler {
+
+	public:
+
+		// most samples buffered, about 100 bytes each
+		static const uint32_t MAX_CAPACITY = 1 << 18;
+
+		Sampler(
+			Aquastream *aquastream,
+			unsigned int intervalMs,
+			unsigned int batchSize,
+			unsigned int capacity,
+			Deadband *deadband,
+			AdaptiveInterval *adaptive,
+			v8::Handle<v8::Function> callback
+		);
+		~Sampler();
+
+		void start();
+		void stop();
+
+		v8::Handle<v8::Object> getStatus();
+
+		static uint64_t now();
+
+	private:
+
+		static void run(void *arg);
+		static void deliver(uv_async_t *async, int status);
+		static void closed(uv_handle_t *handle);
+
+		void flush();
+
+		Aquastream *aquastream;
+		v8::Persistent<v8::Function> callback;
+
+		uint64_t interval;
+		unsigned int batchSize;
+
+		// only reports with changes are delivered to JS if set, owned
+		Deadband *deadband;
+
+		// varies the interval if set, owned
+		AdaptiveInterval *adaptive;
+
+		uv_thread_t thread;
+		uv_async_t async;
+
+		// wakes the thread on stop
+		uv_mutex_t stateLock;
+		uv_cond_t stateCond;
+		bool running;
+
+		// stop() was called, event loop only
+		bool stopping;
+
+		// samples waiting for delivery
+		Ring<Sample> ring;
+		std::vector<Sample> batch;
+
+		// producer side, samples pushed since the last wakeup
+		unsigned int unsignaled;
+
+		// last read error, set by the producer and cleared by the consumer
+		int error;
+
+};
+
+#endif
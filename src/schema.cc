@@ -0,0 +1,350 @@
+/**
+ * Report decoding and encoding with V8
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <v8.h>
+#include <string.h>
+#include <string>
+
+#include "schema.h"
+#include "convert.h"
+
+using namespace v8;
+
+Schema::Node *Schema::dataTree = NULL;
+Schema::Node *Schema::settingsTree = NULL;
+
+/**
+ * The JS side of a conversion: a Number that can't be written unless
+ * specialized
+ */
+template <int conversion> struct Property {
+	static Handle<Value> decode(double number) {
+		return Number::New(number);
+	}
+	static bool encode(Handle<Value>, u_int32_t *) {
+		return false;
+	}
+};
+
+#define PROPERTY(conversion, decoded, encoded) \
+	template <> struct Property<CONVERT_##conversion> { \
+		static Handle<Value> decode(double number) { \
+			return decoded; \
+		} \
+		static bool encode(Handle<Value> value, u_int32_t *raw) { \
+			*raw = encoded; \
+			return true; \
+		} \
+	};
+
+#define READ_ONLY_PROPERTY(conversion, decoded) \
+	template <> struct Property<CONVERT_##conversion> { \
+		static Handle<Value> decode(double number) { \
+			return decoded; \
+		} \
+		static bool encode(Handle<Value>, u_int32_t *) { \
+			return false; \
+		} \
+	};
+
+PROPERTY(RAW, Number::New(number), value->Uint32Value())
+PROPERTY(TEMPERATURE, Number::New(number), Convert::toTemperature(value->NumberValue()))
+PROPERTY(FREQUENCY, Integer::New((int) number), Convert::toFrequency(value->NumberValue()))
+PROPERTY(RESET_CYCLE, Number::New(number), Convert::toFrequencyResetCycle(value->Uint32Value()))
+PROPERTY(TACHO, Number::New(number), Convert::toStaticTachoRpm(value->NumberValue()))
+PROPERTY(PERCENT, Number::New(number), Convert::toScalePercent(value->NumberValue()))
+READ_ONLY_PROPERTY(FAN_RPM, Integer::New((int) number))
+READ_ONLY_PROPERTY(HEX, IO::hexByte((unsigned char) number))
+
+struct Properties {
+	Handle<Value> (*decode)(double number);
+	bool (*encode)(Handle<Value> value, u_int32_t *raw);
+};
+
+#define PROPERTIES(name) { Property<CONVERT_##name>::decode, Property<CONVERT_##name>::encode },
+
+// indexed by SchemaConversion
+static const Properties properties[CONVERT_COUNT] = {
+	SCHEMA_CONVERSIONS(PROPERTIES)
+};
+
+/**
+ * Builds the property trees, call once from IO::Init
+ */
+void Schema::Init() {
+
+	HandleScope scope;
+
+	size_t count;
+	const SchemaField *fields;
+
+	fields = Schema::fields(IO::DATA_REPORT, &count);
+	dataTree = tree(fields, count);
+
+	fields = Schema::fields(IO::SETTINGS_REPORT, &count);
+	settingsTree = tree(fields, count);
+};
+
+/**
+ * Builds the property tree of a field table, objects get a template with
+ * their keys so every instance has the same hidden class
+ */
+Schema::Node *Schema::tree(const SchemaField *fields, size_t count) {
+
+	Node *root = new Node();
+	root->field = NULL;
+
+	std::vector<Node*> objects;
+	objects.push_back(root);
+
+	size_t slot = 0;
+
+	for (size_t i = 0; i < count; i++) {
+
+		Node *parent = root;
+		const char *start = fields[i].path;
+
+		while (true) {
+
+			const char *end = strchr(start, '.');
+			std::string name = end ? std::string(start, end - start) : std::string(start);
+			Local<String> key = String::NewSymbol(name.c_str());
+			Node *node = NULL;
+
+			for (size_t j = 0; j < parent->children.size(); j++) {
+				if (parent->children[j]->key->StrictEquals(key)) {
+					node = parent->children[j];
+					break;
+				}
+			}
+
+			if (!node) {
+				node = new Node();
+				node->key = Persistent<String>::New(key);
+				node->field = end ? NULL : &fields[i];
+				node->slot = slot;
+				node->value = end ? NULL : properties[fields[i].conversion].decode;
+				node->encode = end ? NULL : properties[fields[i].conversion].encode;
+				parent->children.push_back(node);
+
+				if (end)
+					objects.push_back(node);
+			}
+
+			if (!end)
+				break;
+
+			parent = node;
+			start = end + 1;
+		}
+
+		slot += fields[i].count;
+	}
+
+	for (size_t i = 0; i < objects.size(); i++) {
+
+		Local<ObjectTemplate> shape = ObjectTemplate::New();
+
+		for (size_t j = 0; j < objects[i]->children.size(); j++)
+			shape->Set(objects[i]->children[j]->key, Undefined());
+
+		objects[i]->shape = Persistent<ObjectTemplate>::New(shape);
+	}
+
+	return root;
+};
+
+/**
+ * Returns the JS value of a field, an Array for array fields
+ * @param const SchemaField *field
+ * @param const unsigned char *report
+ * @param const IO::pumpSettingsReport *settings Needed for fan rpm
+ * @return Handle<Value>
+ */
+Handle<Value> Schema::decodeField(
+	const SchemaField *field,
+	const unsigned char *report,
+	const IO::pumpSettingsReport *settings
+) {
+
+	Handle<Value> (*value)(double number) = properties[field->conversion].decode;
+
+	if (field->count == 1)
+		return value(field->number(report, 0, settings));
+
+	Local<Array> values = Array::New(field->count);
+
+	for (size_t i = 0; i < field->count; i++)
+		values->Set(i, value(field->number(report, i, settings)));
+
+	return values;
+};
+
+/**
+ * Sets the properties of an object from the values of numbers()
+ */
+void Schema::decodeNode(const Node *node, Handle<Object> object, const double *values) {
+
+	for (size_t i = 0; i < node->children.size(); i++) {
+
+		const Node *child = node->children[i];
+
+		if (!child->field) {
+			Local<Object> nested = child->shape->NewInstance();
+			decodeNode(child, nested, values);
+			object->Set(child->key, nested);
+		} else if (child->field->count == 1) {
+			object->Set(child->key, child->value(values[child->slot]));
+		} else {
+			Local<Array> elements = Array::New(child->field->count);
+
+			for (size_t j = 0; j < child->field->count; j++)
+				elements->Set(j, child->value(values[child->slot + j]));
+
+			object->Set(child->key, elements);
+		}
+	}
+};
+
+/**
+ * Returns the object of a report
+ * @param int reportId
+ * @param const unsigned char *report
+ * @param const IO::pumpSettingsReport *settings
+ * @return Handle<Object>
+ */
+Handle<Object> Schema::decode(int reportId, const unsigned char *report, const IO::pumpSettingsReport *settings) {
+
+	HandleScope scope;
+
+	Node *root = reportId == IO::DATA_REPORT ? dataTree : settingsTree;
+	Local<Object> object = root->shape->NewInstance();
+
+	double values[MAX_ELEMENTS];
+	numbers(reportId, report, settings, values);
+
+	decodeNode(root, object, values);
+
+	return scope.Close(object);
+};
+
+/**
+ * Writes a JS value into the report and marks its bits in mask, read only
+ * fields are skipped
+ */
+void Schema::encodeValue(
+	const Node *node,
+	size_t index,
+	Handle<Value> value,
+	unsigned char *report,
+	unsigned char *mask
+) {
+
+	u_int32_t raw;
+
+	if (!node->encode(value, &raw))
+		return;
+
+	node->field->store(report, index, raw);
+	node->field->store(mask, index, ~0u);
+};
+
+/**
+ * Encodes the properties the object has, so partial objects only cost
+ * lookups for what they contain
+ */
+void Schema::encodeNode(const Node *node, Handle<Object> object, unsigned char *report, unsigned char *mask) {
+
+	Local<Array> names = object->GetOwnPropertyNames();
+
+	for (uint32_t i = 0; i < names->Length(); i++) {
+
+		Local<Value> name = names->Get(i);
+		const Node *child = NULL;
+
+		for (size_t j = 0; j < node->children.size(); j++) {
+			if (node->children[j]->key->StrictEquals(name)) {
+				child = node->children[j];
+				break;
+			}
+		}
+
+		if (!child)
+			continue;
+
+		Local<Value> value = object->Get(name);
+
+		if (!child->field) {
+			if (value->IsObject())
+				encodeNode(child, value->ToObject(), report, mask);
+		} else if (child->field->count == 1) {
+			if (!value->IsUndefined())
+				encodeValue(child, 0, value, report, mask);
+		} else if (value->IsObject()) {
+
+			Local<Object> values = value->ToObject();
+
+			for (size_t j = 0; j < child->field->count; j++) {
+				if (values->Has((uint32_t) j))
+					encodeValue(child, j, values->Get(j), report, mask);
+			}
+		}
+	}
+};
+
+/**
+ * Encodes an object into a zeroed report, the bits of every value it
+ * contains are set in mask
+ *
+ * Unknown and undefined properties are ignored, so a partial object only
+ * sets the fields it has. Getters and valueOf may throw, run it in a
+ * TryCatch.
+ *
+ * @param int reportId
+ * @param Handle<Object> object
+ * @param unsigned char *report
+ * @param unsigned char *mask Same size as report
+ */
+void Schema::encode(int reportId, Handle<Object> object, unsigned char *report, unsigned char *mask) {
+
+	HandleScope scope;
+
+	size_t length = reportId == IO::DATA_REPORT ? sizeof(IO::pumpDataReport) : sizeof(IO::pumpSettingsReport);
+
+	memset(report, 0, length);
+	memset(mask, 0, length);
+
+	encodeNode(reportId == IO::DATA_REPORT ? dataTree : settingsTree, object, report, mask);
+};
+
+/**
+ * Returns the paths of the fields that differ between two reports
+ * @param int reportId
+ * @param const unsigned char *before
+ * @param const unsigned char *after
+ * @return Handle<Array>
+ */
+Handle<Array> Schema::changed(int reportId, const unsigned char *before, const unsigned char *after) {
+
+	HandleScope scope;
+	Local<Array> paths = Array::New();
+
+	size_t count;
+	const SchemaField *fields = Schema::fields(reportId, &count);
+
+	for (size_t i = 0; i < count; i++) {
+		for (size_t j = 0; j < fields[i].count; j++) {
+
+			if (fields[i].raw(before, j) != fields[i].raw(after, j)) {
+				paths->Set(paths->Length(), String::NewSymbol(fields[i].path));
+				break;
+			}
+		}
+	}
+
+	return scope.Close(paths);
+};
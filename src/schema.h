@@ -0,0 +1,155 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <v8.h>
+#include <stddef.h>
+#include <vector>
+
+#include "io.h"
+
+/**
+ * How a raw value is converted, fields without an inverse are read only
+ */
+#define SCHEMA_CONVERSIONS(X) \
+	X(RAW) \
+	X(TEMPERATURE) \
+	X(FREQUENCY) \
+	X(RESET_CYCLE) \
+	X(TACHO) \
+	X(PERCENT) \
+	X(FAN_RPM) \
+	X(FAN_VOLTAGE) \
+	X(FAN_OUTPUT_VOLTAGE) \
+	X(VOLTAGE) \
+	X(CURRENT) \
+	X(PUMP_POWER) \
+	X(CONTROLLER) \
+	X(HEX)
+
+#define SCHEMA_CONVERSION(name) CONVERT_##name,
+
+enum SchemaConversion {
+	SCHEMA_CONVERSIONS(SCHEMA_CONVERSION)
+	CONVERT_COUNT
+};
+
+/**
+ * Describes where a JS property lives in a report and how it is converted
+ */
+struct SchemaField {
+
+	// property path in the result object, e.g. "current.temperature.water"
+	const char *path;
+
+	// struct member, e.g. "rawSensorData[3]"
+	const char *member;
+
+	// byte offset and width of the raw value, of one element for arrays
+	size_t offset;
+	size_t size;
+	size_t count;
+	bool sign;
+
+	// first bit and number of bits, only set by Schema::layout()
+	int bit;
+	int bits;
+	bool bitfield;
+
+	int conversion;
+
+	// the value also depends on another member of the data report
+	bool derived;
+
+	// generated for every entry of the tables in fields.cc, index is the
+	// element of an array field and 0 otherwise
+	u_int32_t (*raw)(const unsigned char *report, size_t index);
+	void (*store)(unsigned char *report, size_t index, u_int32_t raw);
+	double (*convert)(u_int32_t raw, const unsigned char *report, const IO::pumpSettingsReport *settings);
+	double (*number)(const unsigned char *report, size_t index, const IO::pumpSettingsReport *settings);
+};
+
+/**
+ * Decodes and encodes reports as described by the field tables in fields.cc
+ *
+ * The tables are expanded from one list per report, see DATA_FIELDS and
+ * SETTINGS_FIELDS, with accessors generated for every entry. number(),
+ * raw() and store() of a field are plain member access, the conversions
+ * are resolved at compile time. Init() builds a tree of interned keys and
+ * object templates, so decoding and encoding are a walk over that tree.
+ */
+class Schema {
+
+	public:
+
+		// upper bound for the elements of a report, checked in fields.cc
+		static const size_t MAX_ELEMENTS = 64;
+
+		static void Init();
+
+		static const SchemaField *fields(int reportId, size_t *count);
+		static void layout(int reportId, std::vector<SchemaField> *layout);
+
+		static size_t numbers(
+			int reportId,
+			const unsigned char *report,
+			const IO::pumpSettingsReport *settings,
+			double *values
+		);
+
+		static v8::Handle<v8::Object> decode(
+			int reportId,
+			const unsigned char *report,
+			const IO::pumpSettingsReport *settings
+		);
+
+		static void encode(int reportId, v8::Handle<v8::Object> object, unsigned char *report, unsigned char *mask);
+		static v8::Handle<v8::Array> changed(int reportId, const unsigned char *before, const unsigned char *after);
+
+		static v8::Handle<v8::Value> decodeField(
+			const SchemaField *field,
+			const unsigned char *report,
+			const IO::pumpSettingsReport *settings
+		);
+
+	private:
+
+		/**
+		 * A property of the result, either a field or an object
+		 */
+		struct Node {
+			v8::Persistent<v8::String> key;
+			const SchemaField *field;	// NULL for objects
+			size_t slot;	// first value of the field in numbers()
+			v8::Handle<v8::Value> (*value)(double number);
+			bool (*encode)(v8::Handle<v8::Value> value, u_int32_t *raw);
+			v8::Persistent<v8::ObjectTemplate> shape;
+			std::vector<Node*> children;
+		};
+
+		static Node *tree(const SchemaField *fields, size_t count);
+		static void decodeNode(const Node *node, v8::Handle<v8::Object> object, const double *values);
+		static void encodeNode(
+			const Node *node,
+			v8::Handle<v8::Object> object,
+			unsigned char *report,
+			unsigned char *mask
+		);
+		static void encodeValue(
+			const Node *node,
+			size_t index,
+			v8::Handle<v8::Value> value,
+			unsigned char *report,
+			unsigned char *mask
+		);
+
+		static Node *dataTree;
+		static Node *settingsTree;
+
+};
+
+#endif
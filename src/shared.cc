@@ -0,0 +1,187 @@
+/**
+ * Shared memory publication of the latest sample
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shared.h"
+
+static const char SHARED_MAGIC[8] = { 'A', 'Q', 'X', 'T', 'S', 'H', 'M', 0 };
+static const uint32_t SHARED_VERSION = 1;
+
+// a publish takes well under a microsecond, a sequence that stays odd
+// this long belongs to a publisher that died while writing
+static const int SHARED_READ_RETRIES = 100000;
+
+SharedPublisher::SharedPublisher(const char *name, int handle, SharedSegment *segment) {
+	this->name = name;
+	this->handle = handle;
+	this->segment = segment;
+};
+
+/**
+ * Unmaps and removes the segment, readers keep their mapping of it
+ */
+SharedPublisher::~SharedPublisher() {
+
+	munmap(segment, sizeof(SharedSegment));
+	shm_unlink(name.c_str());
+
+	// releases the lock
+	close(handle);
+};
+
+/**
+ * Creates a segment or takes over the one of a publisher that is gone,
+ * the lock on it keeps a second publisher from writing concurrently
+ *
+ * @param const char *name e.g. "/aquastreamxt", see shm_open(3)
+ * @param std::string *error Set on failure
+ * @return SharedPublisher* NULL if it can't be created
+ */
+SharedPublisher *SharedPublisher::open(const char *name, std::string *error) {
+
+	int handle = shm_open(name, O_RDWR | O_CREAT, 0644);
+
+	if (handle < 0) {
+		*error = "Couldn't create shared memory segment ";
+		*error += name;
+		return NULL;
+	}
+
+	if (flock(handle, LOCK_EX | LOCK_NB) < 0) {
+		close(handle);
+		*error = "Another process is publishing to ";
+		*error += name;
+		return NULL;
+	}
+
+	void *memory = MAP_FAILED;
+
+	if (ftruncate(handle, sizeof(SharedSegment)) == 0)
+		memory = mmap(NULL, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+	if (memory == MAP_FAILED) {
+		close(handle);
+		*error = "Couldn't map shared memory segment ";
+		*error += name;
+		return NULL;
+	}
+
+	SharedSegment *segment = (SharedSegment*) memory;
+
+	// a segment of another version is started over
+	if (memcmp(segment->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) || segment->version != SHARED_VERSION) {
+		memset(segment, 0, sizeof(SharedSegment));
+		segment->version = SHARED_VERSION;
+		segment->size = sizeof(SharedSegment);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(segment->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+	}
+
+	// a publisher that died while writing left an odd sequence
+	if (segment->sequence & 1)
+		__atomic_store_n(&segment->sequence, segment->sequence + 1, __ATOMIC_RELEASE);
+
+	return new SharedPublisher(name, handle, segment);
+};
+
+/**
+ * Writes a sample, readers never block it
+ * @param uint64_t timestamp CLOCK_REALTIME in ns
+ * @param const IO::pumpDataReport *data
+ * @param const IO::pumpSettingsReport *settings
+ */
+void SharedPublisher::publish(uint64_t timestamp, const IO::pumpDataReport *data, const IO::pumpSettingsReport *settings) {
+
+	uint32_t sequence = segment->sequence;
+
+	__atomic_store_n(&segment->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	segment->sample.timestamp = timestamp;
+	segment->sample.count++;
+	memcpy(&segment->sample.data, data, sizeof(*data));
+	memcpy(&segment->sample.settings, settings, sizeof(*settings));
+
+	__atomic_store_n(&segment->sequence, sequence + 2, __ATOMIC_RELEASE);
+};
+
+SharedReader::SharedReader(const SharedSegment *segment) {
+	this->segment = segment;
+};
+
+SharedReader::~SharedReader() {
+	munmap((void*) segment, sizeof(SharedSegment));
+};
+
+/**
+ * Maps a segment created by a SharedPublisher
+ * @param const char *name
+ * @return SharedReader* NULL if there is none
+ */
+SharedReader *SharedReader::open(const char *name) {
+
+	int handle = shm_open(name, O_RDONLY, 0);
+
+	if (handle < 0)
+		return NULL;
+
+	struct stat info;
+
+	if (fstat(handle, &info) < 0 || (size_t) info.st_size < sizeof(SharedSegment)) {
+		close(handle);
+		return NULL;
+	}
+
+	void *memory = mmap(NULL, sizeof(SharedSegment), PROT_READ, MAP_SHARED, handle, 0);
+
+	close(handle);
+
+	if (memory == MAP_FAILED)
+		return NULL;
+
+	const SharedSegment *segment = (const SharedSegment*) memory;
+
+	if (memcmp(segment->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) || segment->version != SHARED_VERSION) {
+		munmap(memory, sizeof(SharedSegment));
+		return NULL;
+	}
+
+	return new SharedReader(segment);
+};
+
+/**
+ * Copies a consistent snapshot of the latest sample, gives up after a
+ * bounded number of retries
+ * @param SharedSample *sample
+ * @return int READ_SAMPLE, READ_EMPTY if nothing was published yet or
+ * READ_INCONSISTENT
+ */
+int SharedReader::read(SharedSample *sample) const {
+
+	for (int retry = 0; retry < SHARED_READ_RETRIES; retry++) {
+
+		uint32_t before = __atomic_load_n(&segment->sequence, __ATOMIC_ACQUIRE);
+
+		if (before & 1)
+			continue;
+
+		memcpy(sample, (const void*) &segment->sample, sizeof(*sample));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&segment->sequence, __ATOMIC_RELAXED) == before)
+			return sample->count > 0 ? READ_SAMPLE : READ_EMPTY;
+	}
+
+	return READ_INCONSISTENT;
+};
@@ -0,0 +1,99 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdint.h>
+#include <string>
+
+#include "io.h"
+
+/**
+ * A sample as it is published
+ */
+struct SharedSample {
+
+	// CLOCK_REALTIME of the read in ns
+	uint64_t timestamp;
+
+	// samples published since the segment was created
+	uint64_t count;
+
+	IO::pumpDataReport data;
+	IO::pumpSettingsReport settings;
+};
+
+/**
+ * Layout of the shared memory segment
+ *
+ * sequence is odd while the publisher writes, a reader retries until it
+ * read the same even value before and after copying the sample.
+ */
+struct SharedSegment {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+
+	// on its own cache line, it's the only word both sides touch per sample
+	char pad0[64 - 16];
+	uint32_t sequence;
+	char pad1[64 - 4];
+
+	SharedSample sample;
+};
+
+/**
+ * Publishes samples into a POSIX shared memory segment
+ *
+ * One publisher per name, enforced with a lock on the segment. It's
+ * written from the event loop only.
+ */
+class SharedPublisher {
+
+	public:
+
+		static SharedPublisher *open(const char *name, std::string *error);
+		~SharedPublisher();
+
+		void publish(uint64_t timestamp, const IO::pumpDataReport *data, const IO::pumpSettingsReport *settings);
+
+	private:
+
+		SharedPublisher(const char *name, int handle, SharedSegment *segment);
+
+		std::string name;
+
+		// kept open, it holds the lock
+		int handle;
+		SharedSegment *segment;
+
+};
+
+/**
+ * Maps a published segment read only, read() takes no syscalls
+ */
+class SharedReader {
+
+	public:
+
+		static const int READ_SAMPLE = 1;
+		static const int READ_EMPTY = 0;
+		static const int READ_INCONSISTENT = -1;
+
+		static SharedReader *open(const char *name);
+		~SharedReader();
+
+		int read(SharedSample *sample) const;
+
+	private:
+
+		SharedReader(const SharedSegment *segment);
+
+		const SharedSegment *segment;
+
+};
+
+#endif
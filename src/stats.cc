@@ -0,0 +1,234 @@
+/**
+ * Per thread operation statistics
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+using namespace v8;
+
+Stats::Shard *Stats::shards = NULL;
+
+// shard of the calling thread
+static __thread void *current = NULL;
+
+// releases the shard when its thread exits
+static pthread_key_t key;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+
+static const char *metricNames[Stats::METRICS] = {
+	"HIDIOCGFIELDINFO",
+	"HIDIOCGREPORT",
+	"HIDIOCGUSAGES",
+	"HIDIOCSUSAGES",
+	"HIDIOCSREPORT",
+	"HIDIOCGFEATURE",
+	"HIDIOCSFEATURE",
+	"getData",
+	"getSettings"
+};
+
+/**
+ * CLOCK_MONOTONIC in ns
+ * @return uint64_t
+ */
+uint64_t Stats::now() {
+
+	struct timespec clock;
+	clock_gettime(CLOCK_MONOTONIC, &clock);
+
+	return (uint64_t) clock.tv_sec * 1000000000 + clock.tv_nsec;
+};
+
+void Stats::createKey() {
+	pthread_key_create(&key, release);
+};
+
+void Stats::release(void *shard) {
+	__atomic_store_n(&((Shard*) shard)->owned, 0, __ATOMIC_RELEASE);
+};
+
+/**
+ * Returns the shard of the calling thread, claims one on first use
+ * @return Shard*
+ */
+Stats::Shard *Stats::shard() {
+
+	if (current)
+		return (Shard*) current;
+
+	pthread_once(&keyOnce, createKey);
+
+	Shard *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+
+	// reuse the shard of an exited thread
+	for (; shard; shard = shard->next) {
+
+		int expected = 0;
+
+		if (__atomic_compare_exchange_n(&shard->owned, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (!shard) {
+
+		void *memory;
+
+		if (posix_memalign(&memory, 64, sizeof(Shard)) != 0)
+			return NULL;
+
+		shard = (Shard*) memory;
+		memset(shard, 0, sizeof(Shard));
+		shard->owned = 1;
+		shard->next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+
+		while (!__atomic_compare_exchange_n(&shards, &shard->next, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	current = shard;
+	pthread_setspecific(key, shard);
+
+	return shard;
+};
+
+/**
+ * Log-linear bucket of a latency: values below 8 have their own bucket,
+ * above that each power of two is split into 8 buckets
+ * @param uint64_t ns
+ * @return int
+ */
+int Stats::bucket(uint64_t ns) {
+
+	if (ns < 8)
+		return ns;
+
+	int msb = 63 - __builtin_clzll(ns);
+
+	return (msb - 2) * 8 + ((ns >> (msb - 3)) & 7);
+};
+
+/**
+ * Largest latency that falls into a bucket
+ * @param int bucket
+ * @return uint64_t
+ */
+uint64_t Stats::bucketLimit(int bucket) {
+
+	if (bucket < 8)
+		return bucket;
+
+	int msb = bucket / 8 + 2;
+	uint64_t lower = (uint64_t)(8 + bucket % 8) << (msb - 3);
+
+	return lower + ((uint64_t) 1 << (msb - 3)) - 1;
+};
+
+void Stats::record(int metric, uint64_t start, bool failed) {
+
+	Shard *shard = Stats::shard();
+
+	if (!shard)
+		return;
+
+	uint64_t ns = now() - start;
+	Histogram *histogram = &shard->metrics[metric];
+
+	// only this thread writes, atomics keep readers from seeing torn values
+	__atomic_fetch_add(&histogram->buckets[bucket(ns)], 1, __ATOMIC_RELAXED);
+
+	if (failed)
+		__atomic_fetch_add(&histogram->errors, 1, __ATOMIC_RELAXED);
+
+	if (ns > __atomic_load_n(&histogram->max, __ATOMIC_RELAXED))
+		__atomic_store_n(&histogram->max, ns, __ATOMIC_RELAXED);
+};
+
+/**
+ * Zeroes all shards, operations recorded concurrently may be lost
+ */
+void Stats::reset() {
+
+	for (Shard *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); shard; shard = shard->next) {
+		for (int metric = 0; metric < METRICS; metric++) {
+
+			Histogram *histogram = &shard->metrics[metric];
+
+			__atomic_store_n(&histogram->errors, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&histogram->max, 0, __ATOMIC_RELAXED);
+
+			for (int i = 0; i < BUCKETS; i++)
+				__atomic_store_n(&histogram->buckets[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+};
+
+/**
+ * Sums up all shards
+ * @return Handle<Object> { metric: { count, errors, p50, p99, max } }, latencies in ns
+ */
+Handle<Object> Stats::get() {
+
+	HandleScope scope;
+	Local<Object> stats = Object::New();
+
+	for (int metric = 0; metric < METRICS; metric++) {
+
+		Histogram total;
+		memset(&total, 0, sizeof(total));
+
+		for (Shard *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); shard; shard = shard->next) {
+
+			Histogram *histogram = &shard->metrics[metric];
+
+			total.errors += __atomic_load_n(&histogram->errors, __ATOMIC_RELAXED);
+
+			uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+			if (max > total.max)
+				total.max = max;
+
+			// count from the buckets, so the percentiles add up
+			for (int i = 0; i < BUCKETS; i++) {
+				uint64_t count = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+				total.buckets[i] += count;
+				total.count += count;
+			}
+		}
+
+		uint64_t p50 = 0, p99 = 0, seen = 0;
+		bool median = false;
+		uint64_t rank50 = (total.count + 1) / 2;
+		uint64_t rank99 = total.count - total.count / 100;
+
+		for (int i = 0; i < BUCKETS && seen < rank99; i++) {
+
+			seen += total.buckets[i];
+
+			if (!median && seen >= rank50) {
+				p50 = bucketLimit(i);
+				median = true;
+			}
+
+			if (seen >= rank99)
+				p99 = bucketLimit(i);
+		}
+
+		Local<Object> entry = Object::New();
+		entry->Set(String::NewSymbol("count"), Number::New(total.count));
+		entry->Set(String::NewSymbol("errors"), Number::New(total.errors));
+		entry->Set(String::NewSymbol("p50"), Number::New(p50 < total.max ? p50 : total.max));
+		entry->Set(String::NewSymbol("p99"), Number::New(p99 < total.max ? p99 : total.max));
+		entry->Set(String::NewSymbol("max"), Number::New(total.max));
+
+		stats->Set(String::NewSymbol(metricNames[metric]), entry);
+	}
+
+	return scope.Close(stats);
+};
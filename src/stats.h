@@ -0,0 +1,78 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <v8.h>
+#include <stdint.h>
+
+/**
+ * Counters and latency histograms of the ioctls and report conversions
+ *
+ * Every thread records into its own shard, so recording takes no lock and
+ * doesn't share cache lines with other threads. Shards of exited threads
+ * are reused by new ones. Latencies go into log-linear buckets with eight
+ * buckets per power of two, percentiles are accurate to 12.5%.
+ */
+class Stats {
+
+	public:
+
+		// metrics
+		static const int IOCTL_GET_FIELD_INFO = 0;
+		static const int IOCTL_GET_REPORT = 1;
+		static const int IOCTL_GET_USAGES = 2;
+		static const int IOCTL_SET_USAGES = 3;
+		static const int IOCTL_SET_REPORT = 4;
+		static const int IOCTL_GET_FEATURE = 5;
+		static const int IOCTL_SET_FEATURE = 6;
+		static const int GET_DATA = 7;
+		static const int GET_SETTINGS = 8;
+		static const int METRICS = 9;
+
+		static uint64_t now();
+
+		/**
+		 * Records one operation that started at start (see now())
+		 * @param int metric
+		 * @param uint64_t start
+		 * @param bool failed
+		 */
+		static void record(int metric, uint64_t start, bool failed);
+
+		static v8::Handle<v8::Object> get();
+		static void reset();
+
+	private:
+
+		static const int BUCKETS = 496;
+
+		struct Histogram {
+			uint64_t count; // only set when summed up, see get()
+			uint64_t errors;
+			uint64_t max;
+			uint64_t buckets[BUCKETS];
+		};
+
+		struct Shard {
+			Histogram metrics[METRICS];
+			Shard *next;
+			int owned;
+		} __attribute__((aligned(64)));
+
+		static Shard *shard();
+		static void release(void *shard);
+		static void createKey();
+
+		static int bucket(uint64_t ns);
+		static uint64_t bucketLimit(int bucket);
+
+		// all shards ever created, only ever prepended to
+		static Shard *shards;
+
+};
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * Typed array helpers
+ *
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#include <v8.h>
+
+#include "typedarray.h"
+
+using namespace v8;
+
+/**
+ * Creates a typed array and returns its backing store in data
+ *
+ * @param const char *constructor e.g. "Float64Array"
+ * @param size_t length
+ * @param void **data
+ * @return Local<Object> Empty if the constructor doesn't exist
+ */
+Local<Object> TypedArray::New(const char *constructor, size_t length, void **data) {
+
+	Local<Value> ctor = Context::GetCurrent()->Global()->Get(String::NewSymbol(constructor));
+
+	if (!ctor->IsFunction()) {
+		ThrowException(Exception::Error(String::New("Typed arrays are not available")));
+		return Local<Object>();
+	}
+
+	const unsigned argc = 1;
+	Local<Value> argv[argc] = { Integer::NewFromUnsigned(length) };
+	Local<Object> array = Local<Function>::Cast(ctor)->NewInstance(argc, argv);
+
+	*data = array->GetIndexedPropertiesExternalArrayData();
+
+	return array;
+};
+
+/**
+ * Returns the backing store of a typed array of the given type
+ *
+ * @param Handle<Value> array
+ * @param ExternalArrayType type
+ * @param size_t *length Number of elements
+ * @return void* NULL if array isn't a typed array of that type
+ */
+void *TypedArray::Data(Handle<Value> array, ExternalArrayType type, size_t *length) {
+
+	if (!array->IsObject())
+		return NULL;
+
+	Local<Object> object = array->ToObject();
+
+	if (!object->HasIndexedPropertiesInExternalArrayData() ||
+		object->GetIndexedPropertiesExternalArrayDataType() != type)
+		return NULL;
+
+	*length = object->GetIndexedPropertiesExternalArrayDataLength();
+
+	return object->GetIndexedPropertiesExternalArrayData();
+};
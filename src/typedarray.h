@@ -0,0 +1,22 @@
+/**
+ * @package node-aquastreamxt-api
+ * @author Alexander Dick <alex@dick.at>
+ */
+
+#ifndef TYPEDARRAY_H
+#define TYPEDARRAY_H
+
+#include <v8.h>
+
+using namespace v8;
+
+class TypedArray {
+
+	public:
+
+		static Local<Object> New(const char *constructor, size_t length, void **data);
+		static void *Data(Handle<Value> array, ExternalArrayType type, size_t *length);
+
+};
+
+#endif